@@ -460,6 +460,62 @@ bool BamAlignment::GetArrayTagType(const std::string& tag, char& type) const {
 }
 
 
+/*! \fn const char* BamAlignment::GetEncodedName(void) const
+    \brief Retrieves the read name as stored in the BAM file.
+
+    Unlike the Name field, this is available for alignments retrieved using
+    BamReader::GetNextAlignmentCore(), without calling BuildCharData().
+
+    \return pointer to the null-terminated read name.
+            Null if the alignment holds no BAM data, e.g. it was not read from a BAM file.
+*/
+const char* BamAlignment::GetEncodedName(void) const {
+
+    // make sure data is present
+    if ( SupportData.QueryNameLength == 0 || SupportData.AllCharData.size() < SupportData.QueryNameLength )
+        return 0;
+    return SupportData.AllCharData.data();
+}
+
+/*! \fn const uint8_t* BamAlignment::GetEncodedQualities(void) const
+    \brief Retrieves the base qualities as stored in the BAM file.
+
+    Unlike the Qualities field, these are available for alignments retrieved using
+    BamReader::GetNextAlignmentCore(), without calling BuildCharData().
+
+    \return pointer to Length numeric (phred) quality values, all 0xFF if qualities are not stored.
+            Null if the alignment holds no BAM data, e.g. it was not read from a BAM file.
+*/
+const uint8_t* BamAlignment::GetEncodedQualities(void) const {
+    const uint8_t* bases = GetEncodedQueryBases();
+    if ( bases == 0 )
+        return 0;
+    return bases + (SupportData.QuerySequenceLength+1)/2;
+}
+
+/*! \fn const uint8_t* BamAlignment::GetEncodedQueryBases(void) const
+    \brief Retrieves the query sequence as stored in the BAM file.
+
+    Unlike the QueryBases field, these are available for alignments retrieved using
+    BamReader::GetNextAlignmentCore(), without calling BuildCharData().
+
+    \return pointer to (Length+1)/2 bytes of 4-bit base codes (indexes into "=ACMGRSVTWYHKDBN"),
+            two per byte with the first base in the high nibble.
+            Null if the alignment holds no BAM data, e.g. it was not read from a BAM file, or no sequence.
+*/
+const uint8_t* BamAlignment::GetEncodedQueryBases(void) const {
+
+    // calculate character offsets, as in BuildCharData()
+    const size_t seqDataOffset  = SupportData.QueryNameLength + (SupportData.NumCigarOperations*4);
+    const size_t qualDataOffset = seqDataOffset + (SupportData.QuerySequenceLength+1)/2;
+    const size_t tagDataOffset  = qualDataOffset + SupportData.QuerySequenceLength;
+
+    // make sure data is present
+    if ( SupportData.QuerySequenceLength == 0 || SupportData.AllCharData.size() < tagDataOffset )
+        return 0;
+    return (const uint8_t*)(SupportData.AllCharData.data() + seqDataOffset);
+}
+
 /*! \fn int BamAlignment::GetEndPosition(bool usePadded = false, bool closedInterval = false) const
     \brief Calculates alignment end position, based on its starting position and CIGAR data.
 
@@ -100,6 +100,11 @@ struct API_EXPORT BamAlignment {
         // populates alignment string fields
         bool BuildCharData(void);
 
+        // retrieves BAM-encoded bases & qualities, available without building string fields
+        const char* GetEncodedName(void) const;
+        const uint8_t* GetEncodedQualities(void) const;
+        const uint8_t* GetEncodedQueryBases(void) const;
+
         // calculates alignment end position
         int GetEndPosition(bool usePadded = false, bool closedInterval = false) const;
 
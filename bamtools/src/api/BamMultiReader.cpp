@@ -176,7 +176,8 @@ bool BamMultiReader::GetNextAlignment(BamAlignment& nextAlignment) {
     \brief Retrieves next available alignment.
 
     Equivalent to BamReader::GetNextAlignmentCore() with respect to what is a valid
-    overlapping alignment and what data gets populated.
+    overlapping alignment and what data gets populated, except that
+    BamAlignment::Filename is also set.
 
     This method takes care of determining which alignment actually is 'next'
     across multiple files, depending on their sort order.
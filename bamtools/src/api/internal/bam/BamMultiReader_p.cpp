@@ -591,10 +591,11 @@ bool BamMultiReaderPrivate::PopNextCachedAlignment(BamAlignment& al, const bool
         return false;
 
     // set char data if requested
-    if ( needCharData ) {
+    if ( needCharData )
         alignment->BuildCharData();
-        alignment->Filename = reader->GetFilename();
-    }
+
+    // N.B. - filename is set for core reads too, so callers can tell files apart without char data
+    alignment->Filename = reader->GetFilename();
 
     // store cached alignment into destination parameter (by copy)
     al = *alignment;
@@ -693,9 +693,10 @@ bool ConvertTool::ConvertToolPrivate::RunPileupConversion(BamMultiReader* reader
                                                                    m_settings->IsPrintingPileupMapQualities, 
                                                                    &m_out);
 
-    // set up PileupEngine
+    // set up PileupEngine, positions without coverage are never printed
     PileupEngine pileup;
     pileup.AddVisitor(v);
+    pileup.SetSkipGaps(true);
     
     // iterate through data
     BamAlignment al;
@@ -789,8 +790,8 @@ ConvertPileupFormatVisitor::ConvertPileupFormatVisitor(const RefVector& referenc
         if ( Utilities::FileExists(fastaFilename + ".fai") ) 
             indexFilename = fastaFilename + ".fai";
       
-        // open FASTA file
-        if ( m_fasta.Open(fastaFilename, indexFilename) ) 
+        // open FASTA file, memory-mapped if indexed
+        if ( m_fasta.Open(fastaFilename, indexFilename, true) ) 
             m_hasFasta = true;
     }
 }
@@ -806,7 +807,7 @@ ConvertPileupFormatVisitor::~ConvertPileupFormatVisitor(void) {
 void ConvertPileupFormatVisitor::Visit(const PileupPosition& pileupData ) {
   
     // skip if no alignments at this position
-    if ( pileupData.PileupAlignments.empty() ) return;
+    if ( pileupData.PileupReads.empty() ) return;
   
     // retrieve reference name
     const string& referenceName = m_references[pileupData.RefId].RefName;
@@ -822,7 +823,7 @@ void ConvertPileupFormatVisitor::Visit(const PileupPosition& pileupData ) {
     }
     
     // get count of alleles at this position
-    const int numberAlleles = pileupData.PileupAlignments.size();
+    const int numberAlleles = pileupData.PileupReads.size();
     
     // -----------------------------------------------------------
     // build strings based on alleles at this positionInAlignment
@@ -832,11 +833,11 @@ void ConvertPileupFormatVisitor::Visit(const PileupPosition& pileupData ) {
     stringstream mapQualities("");
     
     // iterate over alignments at this pileup position
-    vector<PileupAlignment>::const_iterator pileupIter = pileupData.PileupAlignments.begin();
-    vector<PileupAlignment>::const_iterator pileupEnd  = pileupData.PileupAlignments.end();
+    vector<PileupRead>::const_iterator pileupIter = pileupData.PileupReads.begin();
+    vector<PileupRead>::const_iterator pileupEnd  = pileupData.PileupReads.end();
     for ( ; pileupIter != pileupEnd; ++pileupIter ) {
-        const PileupAlignment pa = (*pileupIter);
-        const BamAlignment& ba = pa.Alignment;
+        const PileupRead& pa = (*pileupIter);
+        const BamAlignment& ba = *pa.Alignment;
         
         // if beginning of read segment
         if ( pa.IsSegmentBegin )
@@ -865,9 +866,9 @@ void ConvertPileupFormatVisitor::Visit(const PileupPosition& pileupData ) {
             // if next position contains insertion
             if ( pa.IsNextInsertion ) {
                 bases << '+' << pa.InsertionLength;
-                for (int i = 1; i <= pa.InsertionLength; ++i) {
-                    char insertedBase = (char)ba.QueryBases.at(pa.PositionInAlignment + i);
-                    bases << (ba.IsReverseStrand() ? (char)tolower(insertedBase) : (char)toupper(insertedBase) );
+                for (int i = 0; i < pa.InsertedBases.Length; ++i) {
+                    char insertedBase = pa.InsertedBases[i];
+                    bases << (ba.IsReverseStrand() ? (char)tolower(insertedBase) : insertedBase );
                 }
             }
             
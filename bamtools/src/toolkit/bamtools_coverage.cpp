@@ -25,23 +25,26 @@ namespace BamTools {
 // ---------------------------------------------  
 // CoverageVisitor implementation 
   
-class CoverageVisitor : public PileupVisitor {
+class CoverageVisitor : public BatchPileupVisitor {
   
     public:
         CoverageVisitor(const RefVector& references, ostream* out)
-            : PileupVisitor()
+            : BatchPileupVisitor()
             , m_references(references)
             , m_out(out)
         { }
         ~CoverageVisitor(void) { }
   
-    // PileupVisitor interface implementation
+    // BatchPileupVisitor interface implementation
     public:
 	// prints coverage results ( tab-delimited )
-        void Visit(const PileupPosition& pileupData) {
-            *m_out << m_references[pileupData.RefId].RefName << "\t" 
-                   << pileupData.Position << "\t" 
-                   << pileupData.PileupAlignments.size() << endl;
+        void VisitBatch(const PileupPositionBatch& batch) {
+            for ( size_t i = 0; i < batch.Size(); ++i ) {
+                *m_out << m_references[batch.RefIds[i]].RefName << "\t" 
+                       << batch.Positions[i] << "\t" 
+                       << (batch.ReadOffsets[i+1] - batch.ReadOffsets[i]) << "\n";
+            }
+            m_out->flush();
         }
         
     private:
@@ -131,11 +134,11 @@ bool CoverageTool::CoverageToolPrivate::Run(void) {
     
     // set up pileup engine with 'visitor'
     PileupEngine pileup;
-    pileup.AddVisitor(cv);
+    pileup.AddBatchVisitor(cv);
     
     // process input data
     BamAlignment al;    
-    while ( reader.GetNextAlignment(al) ) 
+    while ( reader.GetNextAlignmentCore(al) ) 
         pileup.AddAlignment(al);
     pileup.Flush();
     
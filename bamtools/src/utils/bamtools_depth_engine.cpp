@@ -0,0 +1,306 @@
+// ***************************************************************************
+// bamtools_depth_engine.cpp (c) 2010 Derek Barnett, Erik Garrison
+// Marth Lab, Department of Biology, Boston College
+// ---------------------------------------------------------------------------
+// Last modified: 16 October 2026
+// ---------------------------------------------------------------------------
+// Provides read depth over a region, without building per-position pileups.
+// ***************************************************************************
+
+#include "utils/bamtools_depth_engine.h"
+using namespace BamTools;
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+using namespace std;
+
+// ---------------------------------------------
+// DepthEnginePrivate implementation
+
+struct DepthEngine::DepthEnginePrivate {
+
+    // runs of positions covered by an alignment, in order & clipped to the region
+    typedef vector<pair<int, int> > BlockList;
+
+    // leftmost mate overlapping its mate's start, waiting for the mate to arrive
+    struct PendingMate {
+
+        // data members
+        string Name;
+        int Position;
+        bool IsFirstMate;
+        BlockList Blocks;
+    };
+
+    // pending mates by the position of their mate
+    typedef multimap<int, PendingMate> PendingMateMap;
+
+    // data members
+    int RefId;
+    int LeftPosition;
+    int RightPosition;
+    PileupFilter Filter;
+
+    // depth changes at each position of the region, plus one past its end
+    vector<int> Differences;
+
+    // coverage of the current alignment, & of mates waiting for theirs if merging them
+    BlockList Blocks;
+    PendingMateMap PendingMates;
+
+    // ctor & dtor
+    DepthEnginePrivate(const BamRegion& region)
+        : RefId(region.LeftRefID)
+        , LeftPosition(region.LeftPosition)
+        , RightPosition(region.RightPosition)
+    {
+        // regions without a right bound on the left reference are empty
+        if ( region.RightRefID != region.LeftRefID || RightPosition < LeftPosition )
+            RightPosition = LeftPosition;
+        Differences.assign(RightPosition - LeftPosition + 1, 0);
+    }
+    ~DepthEnginePrivate(void) { }
+
+    // 'public' methods
+    bool AddAlignment(const BamAlignment& al);
+    void GetDepths(vector<int>& depths) const;
+
+    // internal methods
+    private:
+        void AddCoverage(int begin, int end);
+        void AddCoverage(const BamAlignment& al, int begin, int end, int positionInAlignment);
+        bool IsFiltered(const BamAlignment& al) const;
+        bool IsLowQualityBase(const BamAlignment& al, const uint8_t* qualities, const int qualityIndex) const;
+        void MergeMates(const BamAlignment& al);
+        void SubtractOverlap(const BlockList& blocks, const BlockList& mateBlocks);
+};
+
+bool DepthEngine::DepthEnginePrivate::AddAlignment(const BamAlignment& al) {
+
+    // ignore alignments that fail the read filters or lie outside the region
+    if ( !al.IsMapped() || al.RefID != RefId || al.Position >= RightPosition || IsFiltered(al) )
+        return false;
+
+    // the leftmost mate of an overlapping pair defers to its mate, see PileupFilter
+    int clipBegin = RightPosition;
+    int clipEnd   = RightPosition;
+    if ( Filter.ClipOverlaps &&
+         al.IsPaired() &&
+         al.IsMateMapped() &&
+         al.MateRefID == al.RefID &&
+         al.InsertSize > 0 &&
+         al.MatePosition >= al.Position &&
+         !(al.MatePosition == al.Position && al.IsFirstMate()) )
+    {
+        clipBegin = al.MatePosition;
+        clipEnd   = al.Position + al.InsertSize;
+    }
+
+    // collect coverage of each aligned block, around the clipped part
+    Blocks.clear();
+    int genomePosition      = al.Position;
+    int positionInAlignment = 0;
+    vector<CigarOp>::const_iterator cigarIter = al.CigarData.begin();
+    vector<CigarOp>::const_iterator cigarEnd  = al.CigarData.end();
+    for ( ; cigarIter != cigarEnd && genomePosition < RightPosition; ++cigarIter ) {
+        const CigarOp& op = (*cigarIter);
+        switch ( op.Type ) {
+
+            case Constants::BAM_CIGAR_MATCH_CHAR    :
+            case Constants::BAM_CIGAR_SEQMATCH_CHAR :
+            case Constants::BAM_CIGAR_MISMATCH_CHAR : {
+                const int opEnd = genomePosition + op.Length;
+                if ( clipBegin < opEnd && genomePosition < clipEnd ) {
+                    AddCoverage(al, genomePosition, min(clipBegin, opEnd), positionInAlignment);
+                    const int resume = max(clipEnd, genomePosition);
+                    AddCoverage(al, resume, opEnd, positionInAlignment + (resume - genomePosition));
+                }
+                else
+                    AddCoverage(al, genomePosition, opEnd, positionInAlignment);
+                genomePosition      += op.Length;
+                positionInAlignment += op.Length;
+                break;
+            }
+
+            case Constants::BAM_CIGAR_DEL_CHAR    :
+            case Constants::BAM_CIGAR_REFSKIP_CHAR :
+                genomePosition += op.Length;
+                break;
+
+            case Constants::BAM_CIGAR_INS_CHAR      :
+            case Constants::BAM_CIGAR_SOFTCLIP_CHAR :
+                positionInAlignment += op.Length;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // add the alignment's coverage
+    BlockList::const_iterator blockIter = Blocks.begin();
+    BlockList::const_iterator blockEnd  = Blocks.end();
+    for ( ; blockIter != blockEnd; ++blockIter ) {
+        ++Differences[blockIter->first  - LeftPosition];
+        --Differences[blockIter->second - LeftPosition];
+    }
+
+    if ( Filter.MergeOverlappingMates )
+        MergeMates(al);
+    return true;
+}
+
+void DepthEngine::DepthEnginePrivate::AddCoverage(int begin, int end) {
+
+    // clip the block to the region
+    begin = max(begin, LeftPosition);
+    end   = min(end, RightPosition);
+    if ( begin >= end )
+        return;
+
+    // extend the previous block if adjacent
+    if ( !Blocks.empty() && Blocks.back().second == begin )
+        Blocks.back().second = end;
+    else
+        Blocks.push_back( make_pair(begin, end) );
+}
+
+void DepthEngine::DepthEnginePrivate::AddCoverage(const BamAlignment& al, int begin, int end, int positionInAlignment) {
+
+    if ( begin >= end )
+        return;
+
+    // without a base quality filter, the whole block is covered
+    const uint8_t* qualities = al.GetEncodedQualities();
+    if ( Filter.MinBaseQuality <= 0 || (qualities == 0 && al.Qualities.empty()) ) {
+        AddCoverage(begin, end);
+        return;
+    }
+
+    // otherwise add the runs of bases that pass the filter, as in PileupEngine
+    const int first = max(begin, LeftPosition);
+    const int last  = min(end, RightPosition);
+    int runBegin = first;
+    for ( int position = first; position < last; ++position ) {
+        const int qualityIndex = positionInAlignment + (position - begin);
+        if ( IsLowQualityBase(al, qualities, qualityIndex) ) {
+            AddCoverage(runBegin, position);
+            runBegin = position + 1;
+        }
+    }
+    AddCoverage(runBegin, last);
+}
+
+void DepthEngine::DepthEnginePrivate::GetDepths(vector<int>& depths) const {
+
+    // sweep the depth changes over the region
+    const int length = RightPosition - LeftPosition;
+    depths.resize(length);
+    int depth = 0;
+    for ( int i = 0; i < length; ++i ) {
+        depth += Differences[i];
+        depths[i] = depth;
+    }
+}
+
+bool DepthEngine::DepthEnginePrivate::IsFiltered(const BamAlignment& al) const {
+    return ( al.MapQuality < Filter.MinMapQuality ||
+             (al.AlignmentFlag & Filter.RequiredFlags) != Filter.RequiredFlags ||
+             (al.AlignmentFlag & Filter.FilteredFlags) != 0 );
+}
+
+bool DepthEngine::DepthEnginePrivate::IsLowQualityBase(const BamAlignment& al,
+                                                       const uint8_t* qualities,
+                                                       const int qualityIndex) const
+{
+    // read quality from the BAM-encoded data if available, as in PileupEngine
+    // N.B. - Qualities are stored as FASTQ characters, offset by 33; bases without a stored quality are kept
+    uint8_t quality = 0xFF;
+    if ( qualities != 0 && qualityIndex < al.Length )
+        quality = qualities[qualityIndex];
+    else if ( qualities == 0 && qualityIndex < (int)al.Qualities.size() && al.Qualities[qualityIndex] != (char)0xFF )
+        quality = (uint8_t)(al.Qualities[qualityIndex] - 33);
+    return ( quality != 0xFF && (int)quality < Filter.MinBaseQuality );
+}
+
+void DepthEngine::DepthEnginePrivate::MergeMates(const BamAlignment& al) {
+
+    // mates are paired up as in PileupEngine, see PileupFilter
+    if ( !al.IsPaired() || !al.IsMateMapped() || al.MateRefID != al.RefID )
+        return;
+
+    // mates that should have arrived by now never will
+    PendingMates.erase(PendingMates.begin(), PendingMates.lower_bound(al.Position));
+
+    // read name, BAM-encoded if possible
+    const char* name = al.GetEncodedName();
+    if ( name == 0 )
+        name = al.Name.c_str();
+
+    // positions covered by both mates count once
+    pair<PendingMateMap::iterator, PendingMateMap::iterator> range = PendingMates.equal_range(al.Position);
+    for ( PendingMateMap::iterator pendingIter = range.first; pendingIter != range.second; ++pendingIter ) {
+        const PendingMate& mate = pendingIter->second;
+        if ( mate.Position != al.MatePosition ||
+             mate.IsFirstMate == al.IsFirstMate() ||
+             strcmp(mate.Name.c_str(), name) != 0 )
+        {
+            continue;
+        }
+
+        SubtractOverlap(Blocks, mate.Blocks);
+        PendingMates.erase(pendingIter);
+        return;
+    }
+
+    // otherwise wait for the mate, if it starts before this alignment ends
+    if ( al.MatePosition >= al.Position && al.MatePosition < al.GetEndPosition() ) {
+        PendingMateMap::iterator pendingIter = PendingMates.insert( make_pair(al.MatePosition, PendingMate()) );
+        PendingMate& mate = pendingIter->second;
+        mate.Name        = name;
+        mate.Position    = al.Position;
+        mate.IsFirstMate = al.IsFirstMate();
+        mate.Blocks      = Blocks;
+    }
+}
+
+void DepthEngine::DepthEnginePrivate::SubtractOverlap(const BlockList& blocks, const BlockList& mateBlocks) {
+
+    // walk both (ordered) block lists together
+    BlockList::const_iterator blockIter = blocks.begin();
+    BlockList::const_iterator mateIter  = mateBlocks.begin();
+    while ( blockIter != blocks.end() && mateIter != mateBlocks.end() ) {
+        const int begin = max(blockIter->first, mateIter->first);
+        const int end   = min(blockIter->second, mateIter->second);
+        if ( begin < end ) {
+            --Differences[begin - LeftPosition];
+            ++Differences[end - LeftPosition];
+        }
+
+        if ( blockIter->second < mateIter->second )
+            ++blockIter;
+        else
+            ++mateIter;
+    }
+}
+
+// ---------------------------------------------
+// DepthEngine implementation
+
+DepthEngine::DepthEngine(const BamRegion& region)
+    : d( new DepthEnginePrivate(region) )
+{ }
+
+DepthEngine::~DepthEngine(void) {
+    delete d;
+    d = 0;
+}
+
+bool DepthEngine::AddAlignment(const BamAlignment& al) { return d->AddAlignment(al); }
+void DepthEngine::GetDepths(vector<int>& depths) const { d->GetDepths(depths); }
+
+void DepthEngine::SetFilter(const PileupFilter& filter) {
+    d->Filter = filter;
+}
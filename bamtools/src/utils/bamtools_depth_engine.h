@@ -0,0 +1,43 @@
+// ***************************************************************************
+// bamtools_depth_engine.h (c) 2010 Derek Barnett, Erik Garrison
+// Marth Lab, Department of Biology, Boston College
+// ---------------------------------------------------------------------------
+// Last modified: 16 October 2026
+// ---------------------------------------------------------------------------
+// Provides read depth over a region, without building per-position pileups.
+// ***************************************************************************
+
+#ifndef BAMTOOLS_DEPTH_ENGINE_H
+#define BAMTOOLS_DEPTH_ENGINE_H
+
+#include "utils/utils_global.h"
+#include "utils/bamtools_pileup_engine.h"
+
+#include <api/BamAlignment.h>
+#include <vector>
+
+namespace BamTools {
+
+// counts the reads with an aligned base at each position of a region, using the same
+// filters as the pileup engine; deletions & skipped regions do not add to the depth.
+// if merging overlapping mates, a position with a base from both mates counts once
+// N.B. - the depth cap is not applied, depths are always the true ones
+class UTILS_EXPORT DepthEngine {
+  
+    public:
+        DepthEngine(const BamRegion& region);
+        ~DepthEngine(void);
+        
+    public:
+        bool AddAlignment(const BamAlignment& al);
+        void GetDepths(std::vector<int>& depths) const;
+        void SetFilter(const PileupFilter& filter);
+        
+    private:
+        struct DepthEnginePrivate;
+        DepthEnginePrivate* d;
+};
+
+} // namespace BamTools
+
+#endif // BAMTOOLS_DEPTH_ENGINE_H
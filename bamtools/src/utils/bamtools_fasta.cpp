@@ -7,18 +7,29 @@
 // Provides FASTA reading/indexing functionality.
 // ***************************************************************************
 
+#include "api/BamConstants.h"
+#include "api/internal/io/BgzfStream_p.h"
 #include "utils/bamtools_fasta.h"
 using namespace BamTools;
+using namespace BamTools::Internal;
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <vector>
 using namespace std;
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 struct Fasta::FastaPrivate {
   
     struct FastaIndexData {
@@ -28,6 +39,32 @@ struct Fasta::FastaPrivate {
         int32_t LineLength;
         int32_t ByteLength; // LineLength + newline character(s) - varies on OS where file was generated
     };
+
+    // a stretch of the file, starting at a header, scanned for index data on its own thread
+    struct FastaIndexChunk {
+        FastaPrivate* Fasta;
+        int64_t Begin;
+        int64_t End;
+        vector<FastaIndexData> Index;
+        string ErrorString;
+    };
+
+    // start of a BGZF block, in the compressed file & in the uncompressed data, as listed in the .gzi
+    struct FastaBgzfBlock {
+        int64_t CompressedOffset;
+        int64_t UncompressedOffset;
+    };
+
+    // decompressed BGZF block, kept for nearby lookups
+    struct FastaCachedBlock {
+        int64_t Address;
+        int64_t LastUsed;
+        vector<char> Data;
+    };
+
+    // constants
+    static const int64_t MinIndexChunkLength = 1 << 24; // smaller files are not worth splitting
+    static const size_t BlockCacheSize = 8;              // decompressed blocks kept, 64KB each
   
     // data members
     FILE* Stream;
@@ -38,6 +75,17 @@ struct Fasta::FastaPrivate {
     bool IsIndexOpen;
   
     vector<FastaIndexData> Index;
+    vector<char> ReadBuffer;
+
+    const char* MappedData;
+    int64_t MappedLength;
+    bool IsMapped;
+
+    BgzfStream Bgzf;
+    bool IsCompressed;
+    vector<FastaBgzfBlock> BgzfBlocks;
+    vector<FastaCachedBlock> BlockCache;
+    int64_t BlockCacheClock;
     
     // ctor
     FastaPrivate(void);
@@ -45,21 +93,38 @@ struct Fasta::FastaPrivate {
     
     // 'public' API methods
     bool Close(void);
-    bool CreateIndex(const string& indexFilename);
+    bool CreateIndex(const string& indexFilename, const int numThreads);
     bool GetBase(const int& refId, const int& position, char& base);
     bool GetSequence(const int& refId, const int& start, const int& stop, string& sequence);
-    bool Open(const string& filename, const string& indexFilename);
+    bool Open(const string& filename, const string& indexFilename, const bool useMemoryMap);
 	std::vector<std::string> GetReferenceNames();
 	std::vector<int> GetReferenceLengths();
     
     // internal methods
     private:
         void Chomp(char* sequence);
+        bool CopySequence(const char* data,
+                          const int64_t dataLength,
+                          const FastaIndexData& referenceData,
+                          const int start,
+                          const int stop,
+                          string& sequence) const;
+        int64_t GetBaseOffset(const FastaIndexData& referenceData, const int position) const;
         bool GetNameFromHeader(const string& header, string& name);
         bool GetNextHeader(string& header);
-        bool GetNextSequence(string& sequence);
+        bool GetNextSequence(string& sequence, const size_t maxLength = string::npos);
+        int64_t GetVirtualOffset(const int64_t offset, size_t& blockIndex) const;
+        bool IsBgzfFile(void);
+        const vector<char>* LoadBgzfBlock(const size_t blockIndex);
+        bool LoadBgzfIndex(const string& gziFilename);
         bool LoadIndexData(void);
+        bool MapFile(void);
+        bool ReadCompressedData(const int64_t offset, const int64_t length, const char*& data);
         bool Rewind(void);
+        bool ScanIndexChunk(FastaIndexChunk& chunk);
+        static void* ScanIndexChunkMain(void* chunk);
+        bool SkipToSequence(const int& refId);
+        void UnmapFile(void);
         bool WriteIndexData(void);
 };
 
@@ -67,6 +132,11 @@ Fasta::FastaPrivate::FastaPrivate(void)
     : IsOpen(false)
     , HasIndex(false)
     , IsIndexOpen(false)
+    , MappedData(0)
+    , MappedLength(0)
+    , IsMapped(false)
+    , IsCompressed(false)
+    , BlockCacheClock(0)
 { }
 
 Fasta::FastaPrivate::~FastaPrivate(void) {
@@ -96,6 +166,17 @@ void Fasta::FastaPrivate::Chomp(char* sequence) {
 
 bool Fasta::FastaPrivate::Close(void) {
  
+    // unmap fasta file
+    UnmapFile();
+
+    // close BGZF stream & drop its cached blocks
+    if ( IsCompressed ) {
+        Bgzf.Close();
+        BgzfBlocks.clear();
+        BlockCache.clear();
+        IsCompressed = false;
+    }
+
     // close fasta file
     if ( IsOpen ) {
         fclose(Stream);
@@ -113,91 +194,133 @@ bool Fasta::FastaPrivate::Close(void) {
     return true;
 }
 
-bool Fasta::FastaPrivate::CreateIndex(const string& indexFilename) {
+// copies bases [start, stop] of a reference from its text, 'data' pointing at the byte of base 'start'
+bool Fasta::FastaPrivate::CopySequence(const char* data,
+                                       const int64_t dataLength,
+                                       const FastaIndexData& referenceData,
+                                       const int start,
+                                       const int stop,
+                                       string& sequence) const
+{
+    sequence.resize( (stop - start) + 1 );
+
+    // whole lines at a time, skipping the line ends in between
+    const int lineEndLength = referenceData.ByteLength - referenceData.LineLength;
+    int lineOffset = start % referenceData.LineLength;
+    int64_t dataOffset = 0;
+    size_t sequenceOffset = 0;
+    while ( sequenceOffset < sequence.size() ) {
+        const size_t copyLength = min( sequence.size() - sequenceOffset, (size_t)(referenceData.LineLength - lineOffset) );
+        if ( dataOffset + (int64_t)copyLength > dataLength )
+            return false;
+        memcpy(&sequence[sequenceOffset], data + dataOffset, copyLength);
+        sequenceOffset += copyLength;
+        dataOffset += copyLength + lineEndLength;
+        lineOffset = 0;
+    }
+    return true;
+}
+
+bool Fasta::FastaPrivate::CreateIndex(const string& indexFilename, const int numThreads) {
   
     // check that file is open
     if ( !IsOpen ) {
         cerr << "FASTA error : cannot create index, FASTA file not open" << endl;
         return false;
     }
-  
-    // rewind FASTA file
-    if ( !Rewind() ) {
-        cerr << "FASTA error : could not rewind FASTA file" << endl;
+    if ( IsCompressed ) {
+        cerr << "FASTA error : cannot create index of BGZF-compressed FASTA file, index it before compressing" << endl;
         return false;
     }
     
     // clear out prior index data
     Index.clear();
     
-    // -------------------------------------------
-    // calculate lineLength & byteLength
-    
-    int lineLength = 0;
-    int byteLength = 0;
-    
-    // skip over header
-    char buffer[1024];
-    if ( fgets(buffer, 1024, Stream) == 0 ) {
+    // scan through a mapping of the whole file, keeping any mapping the caller asked for
+    const bool wasMapped = IsMapped;
+    if ( !IsMapped && !MapFile() ) {
         cerr << "FASTA error : could not read from file" << endl;
         return false;
     }
-    if ( feof(Stream) ) return false;
-    if ( buffer[0] != '>' ) { 
-        cerr << "FASTA error : expected header ('>'), instead : " << buffer[0] << endl;
+    if ( MappedData[0] != '>' ) {
+        cerr << "FASTA error : expected header ('>'), instead : " << MappedData[0] << endl;
+        if ( !wasMapped ) UnmapFile();
         return false;
     }
-  
-    // read in first line of sequence  
-    char c = fgetc(Stream);
-    while ( (c >= 0) && (c != '\n') ) {
-        ++byteLength;
-        if (isgraph(c)) ++lineLength;
-        c = fgetc(Stream);
-    }
-    ++byteLength; // store newline
     
-    // rewind FASTA file
-    if ( !Rewind() ) {
-        cerr << "FASTA error : could not rewind FASTA file" << endl;
-        return false;
-    }
+    // -------------------------------------------
+    // split file into chunks at headers, for each thread to scan
     
-    // iterate through fasta entries
-    int currentId   = 0;
-    string header   = "";
-    string sequence = "";
-    while ( GetNextHeader(header) ) {
-        
-        // ---------------------------
-        // build index entry data
-        FastaIndexData data;
-        
-        // store file offset of beginning of DNA sequence (after header)
-        data.Offset = ftello(Stream);
+    const int64_t maxChunks = max(MappedLength / MinIndexChunkLength, (int64_t)1);
+    const int numChunks = (int)min((int64_t)max(numThreads, 1), maxChunks);
+    
+    vector<FastaIndexChunk> chunks(numChunks);
+    int64_t chunkBegin = 0;
+    for ( int chunkIndex = 0; chunkIndex < numChunks; ++chunkIndex ) {
         
-        // parse header, store sequence name in data.Name
-        if ( !GetNameFromHeader(header, data.Name) ) {
-            cerr << "FASTA error : could not parse read name from FASTA header" << endl;
-            return false;
+        // each chunk ends at the first header after its share of the file
+        int64_t chunkEnd = MappedLength;
+        if ( chunkIndex + 1 < numChunks ) {
+            chunkEnd = max(MappedLength * (chunkIndex + 1) / numChunks, chunkBegin);
+            while ( chunkEnd < MappedLength ) {
+                const char* newline = (const char*)memchr(MappedData + chunkEnd, '\n', MappedLength - chunkEnd);
+                chunkEnd = ( newline ? newline - MappedData + 1 : MappedLength );
+                if ( chunkEnd < MappedLength && MappedData[chunkEnd] == '>' )
+                    break;
+            }
         }
         
-        // retrieve FASTA sequence
-        if ( !GetNextSequence(sequence) ) {
-            cerr << "FASTA error : could not read in next sequence from FASTA file" << endl;
+        FastaIndexChunk& chunk = chunks[chunkIndex];
+        chunk.Fasta = this;
+        chunk.Begin = chunkBegin;
+        chunk.End   = chunkEnd;
+        chunkBegin  = chunkEnd;
+    }
+    
+    // scan the first chunk here, any others on their own threads
+    vector<pthread_t> threads;
+    for ( int chunkIndex = 1; chunkIndex < numChunks; ++chunkIndex ) {
+        pthread_t thread;
+        if ( pthread_create(&thread, 0, &FastaPrivate::ScanIndexChunkMain, &chunks[chunkIndex]) != 0 )
+            ScanIndexChunk(chunks[chunkIndex]);
+        else
+            threads.push_back(thread);
+    }
+    ScanIndexChunk(chunks[0]);
+    for ( size_t threadIndex = 0; threadIndex < threads.size(); ++threadIndex )
+        pthread_join(threads[threadIndex], 0);
+    
+    if ( !wasMapped ) UnmapFile();
+    
+    // -------------------------------------------
+    // merge chunk entries, in file order
+    
+    for ( int chunkIndex = 0; chunkIndex < numChunks; ++chunkIndex ) {
+        const FastaIndexChunk& chunk = chunks[chunkIndex];
+        if ( !chunk.ErrorString.empty() ) {
+            cerr << "FASTA error : " << chunk.ErrorString << endl;
+            Index.clear();
             return false;
         }
-        
-        // store sequence length & line/byte lengths
-        data.Length = sequence.length();
-        data.LineLength = lineLength;
-        data.ByteLength = byteLength;
-        
-        // store index entry
-        Index.push_back(data);
-        
-        // update ref Id
-        ++currentId;
+        Index.insert(Index.end(), chunk.Index.begin(), chunk.Index.end());
+    }
+    
+    // sequences on a single line (or none) that would fit the first sequence's lines take its line
+    // lengths, as any line length fits them
+    vector<FastaIndexData>::iterator indexIter = Index.begin();
+    vector<FastaIndexData>::iterator indexEnd  = Index.end();
+    for ( ; indexIter != indexEnd; ++indexIter ) {
+        if ( indexIter->Length > 0 )
+            break;
+    }
+    if ( indexIter != indexEnd ) {
+        const FastaIndexData& firstData = (*indexIter);
+        for ( indexIter = Index.begin(); indexIter != indexEnd; ++indexIter ) {
+            if ( indexIter->Length == indexIter->LineLength && indexIter->Length <= firstData.LineLength ) {
+                indexIter->LineLength = firstData.LineLength;
+                indexIter->ByteLength = firstData.ByteLength;
+            }
+        }
     }
     
     // open index file
@@ -248,10 +371,29 @@ bool Fasta::FastaPrivate::GetBase(const int& refId, const int& position, char& b
             return false;
         }
 
-        // calculate seek position & attempt jump
-        const int64_t lines = position / referenceData.LineLength;
-        const int64_t lineOffset = position % referenceData.LineLength;
-        const int64_t seekTo = referenceData.Offset + (lines*referenceData.ByteLength) + lineOffset;
+        // read straight from mapped file, if possible
+        const int64_t seekTo = GetBaseOffset(referenceData, position);
+        if ( IsMapped ) {
+            if ( seekTo >= MappedLength ) {
+                cerr << "FASTA error : position past end of file: " << position << endl;
+                return false;
+            }
+            base = MappedData[seekTo];
+            return true;
+        }
+
+        // or from its decompressed block
+        if ( IsCompressed ) {
+            const char* data = 0;
+            if ( !ReadCompressedData(seekTo, 1, data) ) {
+                cerr << "FASTA error : position past end of file: " << position << endl;
+                return false;
+            }
+            base = data[0];
+            return true;
+        }
+
+        // otherwise attempt jump
         if ( fseek64(Stream, seekTo, SEEK_SET) != 0 ) {
             cerr << "FASTA error : could not seek in file" << endl;
             return false;
@@ -262,33 +404,22 @@ bool Fasta::FastaPrivate::GetBase(const int& refId, const int& position, char& b
         return true;
     }
     
-    // else plow through sequentially
+    // else plow through sequentially, up to the position only
     else {
       
-        // rewind FASTA file
-        if ( !Rewind() ) {
-            cerr << "FASTA error : could not rewind FASTA file" << endl;
+        // find reference
+        if ( !SkipToSequence(refId) ) {
+            cerr << "FASTA error : could not find sequence in FASTA file: " << refId << endl;
             return false;
         }
         
-        // iterate through fasta entries
-        int currentId = 0;
-        string header = "";
-        string sequence = "";
-        
-        // get first entry
-        GetNextHeader(header);
-        GetNextSequence(sequence);
-        
-        while ( currentId != refId ) {
-            GetNextHeader(header);
-            GetNextSequence(sequence);
-            ++currentId;
-        }
-        
         // get desired base from sequence 
         // TODO: error reporting on invalid position
-        if ( currentId == refId && (sequence.length() >= (size_t)position) ) {          
+        string sequence = "";
+        if ( position >= 0 &&
+             GetNextSequence(sequence, (size_t)position + 1) &&
+             (sequence.length() > (size_t)position) )
+        {
             base = sequence.at(position);
             return true;
         }
@@ -301,6 +432,13 @@ bool Fasta::FastaPrivate::GetBase(const int& refId, const int& position, char& b
     return true;
 }
 
+// file offset of a base, from its reference's index data
+int64_t Fasta::FastaPrivate::GetBaseOffset(const FastaIndexData& referenceData, const int position) const {
+    const int64_t lines = position / referenceData.LineLength;
+    const int64_t lineOffset = position % referenceData.LineLength;
+    return referenceData.Offset + (lines*referenceData.ByteLength) + lineOffset;
+}
+
 bool Fasta::FastaPrivate::GetNameFromHeader(const string& header, string& name) {
 
     // get rid of the leading greater than sign
@@ -363,16 +501,17 @@ bool Fasta::FastaPrivate::GetNextHeader(string& header) {
     return true;
 }
 
-bool Fasta::FastaPrivate::GetNextSequence(string& sequence) {
+bool Fasta::FastaPrivate::GetNextSequence(string& sequence, const size_t maxLength) {
   
     // validate input stream
     if ( !IsOpen || feof(Stream) ) 
         return false;
     
-    // read in sequence  
+    // read in sequence, stopping early once 'maxLength' bases are read
     char buffer[1024];
     ostringstream seqBuffer("");
-    while(true) {
+    size_t seqLength = 0;
+    while( seqLength < maxLength ) {
         
         char ch = fgetc(Stream);
         ungetc(ch, Stream);
@@ -386,6 +525,7 @@ bool Fasta::FastaPrivate::GetNextSequence(string& sequence) {
         
         Chomp(buffer);
         seqBuffer << buffer;
+        seqLength += strlen(buffer);
     }
     
     // import buffer contents to sequence string
@@ -421,54 +561,67 @@ bool Fasta::FastaPrivate::GetSequence(const int& refId, const int& start, const
             return false;
         }
         
-        // seek to beginning of sequence data
-        if ( fseeko(Stream, referenceData.Offset, SEEK_SET) != 0 ) {
-            cerr << "FASTA error : could not sek in file" << endl;
-            return false;
+        // N.B. - a stop position at the reference length is allowed, as before, & yields up to the last base
+        const int lastPosition = min(stop, referenceData.Length - 1);
+        if ( start > lastPosition ) {
+            sequence.clear();
+            return true;
         }
-      
-        // retrieve full sequence
-        string fullSequence = "";
-        if ( !GetNextSequence(fullSequence) ) {
-            cerr << "FASTA error : could not retrieve sequence from FASTA file" << endl;
-            return false;
+
+        // byte span of the requested bases, line ends included
+        const int64_t startOffset = GetBaseOffset(referenceData, start);
+        const int64_t spanLength  = GetBaseOffset(referenceData, lastPosition) + 1 - startOffset;
+
+        // use mapped file or cached blocks if possible, otherwise read just the span in one go
+        const char* data = 0;
+        if ( IsMapped ) {
+            if ( startOffset + spanLength > MappedLength ) {
+                cerr << "FASTA error : could not retrieve sequence from FASTA file" << endl;
+                return false;
+            }
+            data = MappedData + startOffset;
         }
-        
-        // set sub-sequence & return success
-        const int seqLength = (stop - start) + 1;
-        sequence = fullSequence.substr(start, seqLength);
-        return true;
+        else if ( IsCompressed ) {
+            if ( !ReadCompressedData(startOffset, spanLength, data) ) {
+                cerr << "FASTA error : could not retrieve sequence from FASTA file" << endl;
+                return false;
+            }
+        }
+        else {
+            ReadBuffer.resize(spanLength);
+            if ( fseek64(Stream, startOffset, SEEK_SET) != 0 ) {
+                cerr << "FASTA error : could not seek in file" << endl;
+                return false;
+            }
+            if ( fread(&ReadBuffer[0], 1, spanLength, Stream) != (size_t)spanLength ) {
+                cerr << "FASTA error : could not retrieve sequence from FASTA file" << endl;
+                return false;
+            }
+            data = &ReadBuffer[0];
+        }
+
+        // strip line ends
+        return CopySequence(data, spanLength, referenceData, start, lastPosition, sequence);
     }
     
-    // else plow through sequentially
+    // else plow through sequentially, up to the stop position only
     else {
       
-        // rewind FASTA file
-        if ( !Rewind() ) {
-            cerr << "FASTA error : could not rewind FASTA file" << endl;
+        // find reference
+        if ( !SkipToSequence(refId) ) {
+            cerr << "FASTA error : could not find sequence in FASTA file: " << refId << endl;
             return false;
         }
-     
-        // iterate through fasta entries
-        int currentId = 0;
-        string header = "";
-        string fullSequence = "";
-        
-        // get first entry
-        GetNextHeader(header);
-        GetNextSequence(fullSequence);
-        
-        while ( currentId != refId ) {
-            GetNextHeader(header);
-            GetNextSequence(fullSequence);
-            ++currentId;
-        }
         
         // get desired substring from sequence
         // TODO: error reporting on invalid start/stop positions
-        if ( currentId == refId && (fullSequence.length() >= (size_t)stop) ) {          
+        string partialSequence = "";
+        if ( GetNextSequence(partialSequence, (size_t)stop + 1) &&
+             (partialSequence.length() >= (size_t)stop) &&
+             (start >= 0) && (start <= stop) )
+        {
             const int seqLength = (stop - start) + 1;
-            sequence = fullSequence.substr(start, seqLength);
+            sequence = partialSequence.substr(start, seqLength);
             return true;
         }
       
@@ -480,6 +633,128 @@ bool Fasta::FastaPrivate::GetSequence(const int& refId, const int& start, const
     return true;
 }
 
+// BGZF virtual offset of an uncompressed file offset, as used in the .fai, & the index of its block
+int64_t Fasta::FastaPrivate::GetVirtualOffset(const int64_t offset, size_t& blockIndex) const {
+
+    if ( BgzfBlocks.empty() || offset < 0 )
+        return -1;
+
+    // find last block starting at or before offset
+    size_t low  = 0;
+    size_t high = BgzfBlocks.size();
+    while ( high - low > 1 ) {
+        const size_t middle = (low + high) / 2;
+        if ( BgzfBlocks[middle].UncompressedOffset <= offset )
+            low = middle;
+        else
+            high = middle;
+    }
+
+    // offsets past the end would overflow the last block
+    const FastaBgzfBlock& block = BgzfBlocks[low];
+    const int64_t blockOffset = offset - block.UncompressedOffset;
+    if ( blockOffset >= (int64_t)Constants::BGZF_MAX_BLOCK_SIZE )
+        return -1;
+
+    blockIndex = low;
+    return ( (block.CompressedOffset << 16) | blockOffset );
+}
+
+// checks for a BGZF block header at the start of the file
+bool Fasta::FastaPrivate::IsBgzfFile(void) {
+
+    char header[Constants::BGZF_BLOCK_HEADER_LENGTH];
+    const size_t numBytesRead = fread(header, 1, Constants::BGZF_BLOCK_HEADER_LENGTH, Stream);
+    const bool isBgzf = ( numBytesRead == Constants::BGZF_BLOCK_HEADER_LENGTH && BgzfStream::CheckBlockHeader(header) );
+    Rewind();
+    return isBgzf;
+}
+
+// decompressed data of a block, from the cache if possible
+const vector<char>* Fasta::FastaPrivate::LoadBgzfBlock(const size_t blockIndex) {
+
+    // check cache first
+    const int64_t blockAddress = BgzfBlocks[blockIndex].CompressedOffset;
+    ++BlockCacheClock;
+    vector<FastaCachedBlock>::iterator cacheIter = BlockCache.begin();
+    vector<FastaCachedBlock>::iterator cacheEnd  = BlockCache.end();
+    vector<FastaCachedBlock>::iterator leastRecent = cacheIter;
+    for ( ; cacheIter != cacheEnd; ++cacheIter ) {
+        if ( cacheIter->Address == blockAddress ) {
+            cacheIter->LastUsed = BlockCacheClock;
+            return &cacheIter->Data;
+        }
+        if ( cacheIter->LastUsed < leastRecent->LastUsed )
+            leastRecent = cacheIter;
+    }
+
+    // otherwise take a new slot, or the least recently used one
+    if ( BlockCache.size() < BlockCacheSize ) {
+        BlockCache.push_back(FastaCachedBlock());
+        leastRecent = BlockCache.end() - 1;
+    }
+    FastaCachedBlock& cachedBlock = (*leastRecent);
+    cachedBlock.Address  = -1;
+    cachedBlock.LastUsed = BlockCacheClock;
+
+    // blocks hold at most 64KB, the .gzi gives the exact length of all but the last
+    size_t blockLength = Constants::BGZF_MAX_BLOCK_SIZE;
+    if ( blockIndex + 1 < BgzfBlocks.size() )
+        blockLength = (size_t)( BgzfBlocks[blockIndex + 1].UncompressedOffset - BgzfBlocks[blockIndex].UncompressedOffset );
+
+    // decompress block
+    try {
+        cachedBlock.Data.resize(blockLength);
+        Bgzf.Seek(blockAddress << 16);
+        cachedBlock.Data.resize( Bgzf.Read(&cachedBlock.Data[0], blockLength) );
+    }
+    catch ( const std::exception& e ) {
+        cerr << "FASTA error : could not read BGZF block: " << e.what() << endl;
+        return 0;
+    }
+
+    cachedBlock.Address = blockAddress;
+    return &cachedBlock.Data;
+}
+
+// reads the block offsets of a .gzi file (as written by bgzip -i or samtools faidx)
+bool Fasta::FastaPrivate::LoadBgzfIndex(const string& gziFilename) {
+
+    FILE* gziStream = fopen(gziFilename.c_str(), "rb");
+    if ( !gziStream ) {
+        cerr << "FASTA error : Could not open " << gziFilename << " for reading." << endl;
+        return false;
+    }
+
+    // number of blocks, then the offsets of every block but the first
+    // N.B. - all values are little-endian, 64-bit unsigned
+    const bool isBigEndian = SystemIsBigEndian();
+    uint64_t numBlocks = 0;
+    bool success = ( fread(&numBlocks, sizeof(numBlocks), 1, gziStream) == 1 );
+    if ( isBigEndian ) SwapEndian_64(numBlocks);
+
+    BgzfBlocks.clear();
+    FastaBgzfBlock firstBlock = { 0, 0 };
+    BgzfBlocks.push_back(firstBlock);
+    for ( uint64_t blockIndex = 0; success && blockIndex < numBlocks; ++blockIndex ) {
+        uint64_t offsets[2];
+        success = ( fread(offsets, sizeof(uint64_t), 2, gziStream) == 2 );
+        if ( isBigEndian ) {
+            SwapEndian_64(offsets[0]);
+            SwapEndian_64(offsets[1]);
+        }
+        FastaBgzfBlock block = { (int64_t)offsets[0], (int64_t)offsets[1] };
+        BgzfBlocks.push_back(block);
+    }
+    fclose(gziStream);
+
+    if ( !success ) {
+        cerr << "FASTA error : could not read BGZF index data from " << gziFilename << endl;
+        BgzfBlocks.clear();
+    }
+    return success;
+}
+
 bool Fasta::FastaPrivate::LoadIndexData(void) {
   
     // skip if no index file available
@@ -524,7 +799,31 @@ bool Fasta::FastaPrivate::LoadIndexData(void) {
     return true;
 }
 
-bool Fasta::FastaPrivate::Open(const string& filename, const string& indexFilename) {
+bool Fasta::FastaPrivate::MapFile(void) {
+
+    // map whole file read-only, pages are shared with other processes mapping it
+    const int fileDescriptor = fileno(Stream);
+    struct stat fileStat;
+    if ( fstat(fileDescriptor, &fileStat) != 0 ) {
+        cerr << "FASTA error : could not stat file for memory mapping" << endl;
+        return false;
+    }
+    if ( fileStat.st_size == 0 )
+        return false;
+
+    void* data = mmap(0, fileStat.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    if ( data == MAP_FAILED ) {
+        cerr << "FASTA error : could not memory map file" << endl;
+        return false;
+    }
+
+    MappedData   = (const char*)data;
+    MappedLength = fileStat.st_size;
+    IsMapped     = true;
+    return true;
+}
+
+bool Fasta::FastaPrivate::Open(const string& filename, const string& indexFilename, const bool useMemoryMap) {
  
     bool success = true;
   
@@ -536,6 +835,24 @@ bool Fasta::FastaPrivate::Open(const string& filename, const string& indexFilena
     }
     IsOpen = true;
     success &= IsOpen;
+
+    // BGZF-compressed files are only read through their .fai & .gzi indexes
+    IsCompressed = IsBgzfFile();
+    if ( IsCompressed ) {
+        if ( indexFilename.empty() ) {
+            cerr << "FASTA error : BGZF-compressed FASTA file " << filename << " requires an index" << endl;
+            return false;
+        }
+        if ( !LoadBgzfIndex(filename + ".gzi") )
+            return false;
+        try {
+            Bgzf.Open(filename, IBamIODevice::ReadOnly);
+        }
+        catch ( const std::exception& e ) {
+            cerr << "FASTA error : " << e.what() << endl;
+            return false;
+        }
+    }
     
     // open index file if it exists
     if ( !indexFilename.empty() ) {
@@ -550,17 +867,155 @@ bool Fasta::FastaPrivate::Open(const string& filename, const string& indexFilena
         // attempt to load index data
         HasIndex = LoadIndexData();
         success &= HasIndex;
+
+        // map file if requested, lookups only use the mapping when indexed & uncompressed
+        if ( HasIndex && useMemoryMap && !IsCompressed )
+            success &= MapFile();
     }
     
     // return success status
     return success;
 }
 
+// BGZF data at an uncompressed file 'offset', straight from its cached block if not crossing into the next
+bool Fasta::FastaPrivate::ReadCompressedData(const int64_t offset, const int64_t length, const char*& data) {
+
+    ReadBuffer.resize(length);
+    int64_t numBytesCopied = 0;
+    while ( numBytesCopied < length ) {
+
+        // locate block holding the next byte
+        size_t blockIndex = 0;
+        const int64_t virtualOffset = GetVirtualOffset(offset + numBytesCopied, blockIndex);
+        if ( virtualOffset < 0 )
+            return false;
+        const vector<char>* block = LoadBgzfBlock(blockIndex);
+        const size_t blockOffset = (size_t)(virtualOffset & 0xFFFF);
+        if ( block == 0 || blockOffset >= block->size() )
+            return false;
+
+        // whole span within one block
+        const int64_t copyLength = min(length - numBytesCopied, (int64_t)(block->size() - blockOffset));
+        if ( numBytesCopied == 0 && copyLength == length ) {
+            data = &(*block)[blockOffset];
+            return true;
+        }
+
+        memcpy(&ReadBuffer[numBytesCopied], &(*block)[blockOffset], copyLength);
+        numBytesCopied += copyLength;
+    }
+
+    data = &ReadBuffer[0];
+    return true;
+}
+
 bool Fasta::FastaPrivate::Rewind(void) {
     if ( !IsOpen ) return false;
     return ( fseeko(Stream, 0, SEEK_SET) == 0 );
 }
 
+// scans the mapped headers & sequence lines of a chunk into index entries
+// N.B. - within a sequence, every line but the last must have the same length
+bool Fasta::FastaPrivate::ScanIndexChunk(FastaIndexChunk& chunk) {
+
+    const char* data      = MappedData;
+    const int64_t dataEnd = chunk.End;
+    int64_t lineBegin     = chunk.Begin;
+
+    while ( lineBegin < dataEnd ) {
+
+        // header line
+        const char* newline = (const char*)memchr(data + lineBegin, '\n', dataEnd - lineBegin);
+        const int64_t headerEnd = ( newline ? newline - data + 1 : dataEnd );
+
+        FastaIndexData entry;
+        if ( !GetNameFromHeader(string(data + lineBegin, headerEnd - lineBegin), entry.Name) ) {
+            chunk.ErrorString = "could not parse read name from FASTA header";
+            return false;
+        }
+        entry.Offset     = headerEnd;
+        entry.Length     = 0;
+        entry.LineLength = 0;
+        entry.ByteLength = 0;
+
+        // sequence lines, up to the next header
+        bool isLastLine = false;
+        lineBegin = headerEnd;
+        while ( lineBegin < dataEnd && data[lineBegin] != '>' ) {
+
+            newline = (const char*)memchr(data + lineBegin, '\n', dataEnd - lineBegin);
+            const int64_t lineEnd = ( newline ? newline - data + 1 : dataEnd );
+            const int byteLength  = (int)(lineEnd - lineBegin);
+            int lineLength = byteLength;
+            while ( lineLength > 0 && (data[lineBegin + lineLength - 1] == '\n' || data[lineBegin + lineLength - 1] == '\r') )
+                --lineLength;
+
+            // first line sets the line lengths, any shorter line must be the last
+            if ( entry.ByteLength == 0 ) {
+                entry.LineLength = lineLength;
+                entry.ByteLength = byteLength;
+            }
+            else if ( (isLastLine && lineLength > 0) || lineLength > entry.LineLength ) {
+                stringstream message;
+                message << "inconsistent line length in sequence " << entry.Name << ", at byte " << lineBegin;
+                chunk.ErrorString = message.str();
+                return false;
+            }
+            if ( lineLength != entry.LineLength || byteLength != entry.ByteLength )
+                isLastLine = true;
+
+            entry.Length += lineLength;
+            lineBegin = lineEnd;
+        }
+
+        chunk.Index.push_back(entry);
+    }
+
+    return true;
+}
+
+void* Fasta::FastaPrivate::ScanIndexChunkMain(void* chunk) {
+    FastaIndexChunk* indexChunk = (FastaIndexChunk*)chunk;
+    indexChunk->Fasta->ScanIndexChunk(*indexChunk);
+    return 0;
+}
+
+// rewinds & reads up to the sequence data of 'refId', without keeping any preceding sequence
+bool Fasta::FastaPrivate::SkipToSequence(const int& refId) {
+
+    if ( refId < 0 || !Rewind() )
+        return false;
+
+    string header = "";
+    char buffer[1024];
+    for ( int currentId = 0; GetNextHeader(header); ++currentId ) {
+        if ( currentId == refId )
+            return true;
+
+        // skip sequence lines, up to next header
+        while ( true ) {
+            const int ch = fgetc(Stream);
+            if ( ch == EOF )
+                return false;
+            ungetc(ch, Stream);
+            if ( ch == '>' )
+                break;
+            if ( fgets(buffer, 1024, Stream) == 0 )
+                return false;
+        }
+    }
+    return false;
+}
+
+void Fasta::FastaPrivate::UnmapFile(void) {
+    if ( IsMapped ) {
+        munmap((void*)MappedData, MappedLength);
+        MappedData = 0;
+        MappedLength = 0;
+        IsMapped = false;
+    }
+}
+
 bool Fasta::FastaPrivate::WriteIndexData(void) {
  
     // skip if no index file available
@@ -634,8 +1089,8 @@ bool Fasta::Close(void) {
     return d->Close();
 }
 
-bool Fasta::CreateIndex(const string& indexFilename) {
-    return d->CreateIndex(indexFilename);
+bool Fasta::CreateIndex(const string& indexFilename, const int numThreads) {
+    return d->CreateIndex(indexFilename, numThreads);
 }
 
 bool Fasta::GetBase(const int& refId, const int& position, char& base) {
@@ -646,8 +1101,8 @@ bool Fasta::GetSequence(const int& refId, const int& start, const int& stop, str
     return d->GetSequence(refId, start, stop, sequence);
 }
 
-bool Fasta::Open(const string& filename, const string& indexFilename) {
-    return d->Open(filename, indexFilename);
+bool Fasta::Open(const string& filename, const string& indexFilename, const bool useMemoryMap) {
+    return d->Open(filename, indexFilename, useMemoryMap);
 }
 
 std::vector<std::string> Fasta::GetReferenceNames() {
@@ -26,7 +26,13 @@ class UTILS_EXPORT Fasta {
     // file-handling methods
     public:
         bool Close(void);
-        bool Open(const std::string& filename, const std::string& indexFilename = "");
+        // N.B. - with an index, the file may be memory-mapped: lookups then read mapped pages directly,
+        //        shared read-only with any other process mapping the same file
+        // N.B. - a BGZF-compressed (bgzip) file needs both its .fai index & the .gzi block index next to
+        //        it (as written by 'samtools faidx'); it is never memory-mapped
+        bool Open(const std::string& filename,
+                  const std::string& indexFilename = "",
+                  const bool useMemoryMap = false);
 	
     // sequence access methods
     public:
@@ -37,7 +43,9 @@ class UTILS_EXPORT Fasta {
     public:
 		std::vector<std::string> GetReferenceNames();
 		std::vector<int> GetReferenceLengths();
-        bool CreateIndex(const std::string& indexFilename);
+        // N.B. - files of 32 MB or more are scanned on up to 'numThreads' threads,
+        //        split at sequence headers
+        bool CreateIndex(const std::string& indexFilename, const int numThreads = 1);
 
     // internal implementation
     private:
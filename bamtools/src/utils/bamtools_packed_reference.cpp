@@ -0,0 +1,452 @@
+// ***************************************************************************
+// bamtools_packed_reference.cpp (c) 2010 Derek Barnett, Erik Garrison
+// Marth Lab, Department of Biology, Boston College
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Provides an in-memory, 2-bit packed copy of reference sequences.
+// ***************************************************************************
+
+#include "utils/bamtools_packed_reference.h"
+#include "utils/bamtools_fasta.h"
+using namespace BamTools;
+
+#include <pthread.h>
+#include <algorithm>
+#include <cctype>
+#include <list>
+#include <sstream>
+using namespace std;
+
+// ---------------------------------------------
+// PackedReferencePrivate implementation
+
+struct PackedReference::PackedReferencePrivate {
+
+    // constants
+    static const int LoadChunkLength = 1 << 20;    // bases read from the FASTA file at a time
+    static const uint8_t CodeN = 4;
+
+    // reference held in memory, base i in bits 2*(i%4) of byte i/4 (A=0, C=1, G=2, T=3)
+    struct PackedContig {
+
+        // data members
+        vector<uint8_t> Bases;
+        vector<int> RunStarts;    // runs of a character other than ACGT, 0-based & half-open, in order
+        vector<int> RunEnds;
+        vector<char> RunBases;    // that character, as in the FASTA file
+        vector<int> LowerStarts;  // runs of lower case acgt, 0-based & half-open, in order
+        vector<int> LowerEnds;
+        int PinCount;
+        bool IsLoaded;
+        list<int>::iterator RecentIter;
+
+        // ctor
+        PackedContig(void)
+            : PinCount(0)
+            , IsLoaded(false)
+        { }
+
+        // methods
+        size_t GetMemory(void) const {
+            return Bases.size() + RunBases.size() +
+                   (RunStarts.size() + RunEnds.size() + LowerStarts.size() + LowerEnds.size())*sizeof(int);
+        }
+    };
+
+    // lookup tables
+    static uint8_t EncodeTable[256];
+    static char DecodeTable[256][4];
+    static pthread_once_t TableInitialization;
+
+    // data members
+    Fasta Reference;
+    bool IsOpen;
+    vector<string> Names;
+    vector<int> Lengths;
+    vector<PackedContig> Contigs;
+    list<int> RecentContigs;   // loaded references, most recently used first
+    size_t UsedMemory;
+    size_t MemoryBudget;
+    string ErrorString;
+    pthread_mutex_t Mutex;
+
+    // ctor & dtor
+    PackedReferencePrivate(void)
+        : IsOpen(false)
+        , UsedMemory(0)
+        , MemoryBudget(0)
+    {
+        pthread_mutex_init(&Mutex, 0);
+        pthread_once(&TableInitialization, &InitializeTables);
+    }
+
+    ~PackedReferencePrivate(void) {
+        Close();
+        pthread_mutex_destroy(&Mutex);
+    }
+
+    // 'public' methods
+    void Close(void);
+    bool GetBases(const int refId, const vector<int>& positions, string& bases);
+    bool GetWindow(const int refId, const int start, const int length, string& sequence);
+    bool Open(const string& filename, const string& indexFilename);
+
+    // internal methods
+    private:
+        void EvictContigs(const size_t neededMemory);
+        static int FindRun(const vector<int>& starts, const vector<int>& ends, const int position);
+        static void InitializeTables(void);
+        bool LoadContig(const int refId);
+        const PackedContig* PinContig(const int refId);
+        void SetErrorString(const string& message);
+        void UnloadContig(const int refId);
+        void UnpinContig(const int refId);
+};
+
+uint8_t PackedReference::PackedReferencePrivate::EncodeTable[256];
+char PackedReference::PackedReferencePrivate::DecodeTable[256][4];
+pthread_once_t PackedReference::PackedReferencePrivate::TableInitialization = PTHREAD_ONCE_INIT;
+
+void PackedReference::PackedReferencePrivate::Close(void) {
+
+    pthread_mutex_lock(&Mutex);
+    if ( IsOpen ) {
+        Reference.Close();
+        IsOpen = false;
+    }
+    Names.clear();
+    Lengths.clear();
+    Contigs.clear();
+    RecentContigs.clear();
+    UsedMemory = 0;
+    pthread_mutex_unlock(&Mutex);
+}
+
+void PackedReference::PackedReferencePrivate::EvictContigs(const size_t neededMemory) {
+
+    if ( MemoryBudget == 0 )
+        return;
+
+    // unload least recently used references until the new one fits, skipping any in use
+    list<int>::iterator recentIter = RecentContigs.end();
+    while ( UsedMemory + neededMemory > MemoryBudget && recentIter != RecentContigs.begin() ) {
+        --recentIter;
+        const int refId = (*recentIter);
+        if ( Contigs[refId].PinCount > 0 )
+            continue;
+        ++recentIter;
+        UnloadContig(refId);
+    }
+}
+
+bool PackedReference::PackedReferencePrivate::GetBases(const int refId, const vector<int>& positions, string& bases) {
+
+    const PackedContig* contig = PinContig(refId);
+    if ( contig == 0 )
+        return false;
+
+    const int length = Lengths[refId];
+    bases.resize(positions.size());
+    for ( size_t i = 0; i < positions.size(); ++i ) {
+        const int position = positions[i];
+        if ( position < 0 || position >= length ) {
+            bases[i] = 'N';
+            continue;
+        }
+
+        // a run's own character if within one, otherwise the packed base in its case
+        const int runIndex = FindRun(contig->RunStarts, contig->RunEnds, position);
+        if ( runIndex >= 0 )
+            bases[i] = contig->RunBases[runIndex];
+        else if ( FindRun(contig->LowerStarts, contig->LowerEnds, position) >= 0 )
+            bases[i] = tolower(DecodeTable[ contig->Bases[position >> 2] ][ position & 3 ]);
+        else
+            bases[i] = DecodeTable[ contig->Bases[position >> 2] ][ position & 3 ];
+    }
+
+    UnpinContig(refId);
+    return true;
+}
+
+bool PackedReference::PackedReferencePrivate::GetWindow(const int refId, const int start, const int length, string& sequence) {
+
+    if ( start < 0 || length < 0 ) {
+        stringstream s("");
+        s << "PackedReference::GetWindow() : invalid window: " << start << ", " << length;
+        pthread_mutex_lock(&Mutex);
+        SetErrorString(s.str());
+        pthread_mutex_unlock(&Mutex);
+        return false;
+    }
+
+    const PackedContig* contig = PinContig(refId);
+    if ( contig == 0 )
+        return false;
+
+    // decode whole bytes at a time
+    const int end = (int)min( (int64_t)start + length, (int64_t)Lengths[refId] );
+    sequence.resize( max(end - start, 0) );
+    int position = start;
+    while ( position < end ) {
+        const int byteOffset = position & 3;
+        const int copyLength = min(4 - byteOffset, end - position);
+        const char* decoded = DecodeTable[ contig->Bases[position >> 2] ];
+        for ( int i = 0; i < copyLength; ++i )
+            sequence[position - start + i] = decoded[byteOffset + i];
+        position += copyLength;
+    }
+
+    // then restore lower case bases & the characters of runs overlapping the window
+    vector<int>::const_iterator lowerIter = upper_bound(contig->LowerEnds.begin(), contig->LowerEnds.end(), start);
+    for ( ; lowerIter != contig->LowerEnds.end(); ++lowerIter ) {
+        const int lowerStart = contig->LowerStarts[lowerIter - contig->LowerEnds.begin()];
+        if ( lowerStart >= end )
+            break;
+        const int maskStart = max(lowerStart, start);
+        const int maskEnd   = min(*lowerIter, end);
+        for ( int i = maskStart - start; i < maskEnd - start; ++i )
+            sequence[i] = tolower(sequence[i]);
+    }
+
+    vector<int>::const_iterator runIter = upper_bound(contig->RunEnds.begin(), contig->RunEnds.end(), start);
+    for ( ; runIter != contig->RunEnds.end(); ++runIter ) {
+        const size_t runIndex = runIter - contig->RunEnds.begin();
+        const int runStart = contig->RunStarts[runIndex];
+        if ( runStart >= end )
+            break;
+        const int maskStart = max(runStart, start);
+        const int maskEnd   = min(*runIter, end);
+        fill(sequence.begin() + (maskStart - start), sequence.begin() + (maskEnd - start), contig->RunBases[runIndex]);
+    }
+
+    UnpinContig(refId);
+    return true;
+}
+
+int PackedReference::PackedReferencePrivate::FindRun(const vector<int>& starts, const vector<int>& ends, const int position) {
+
+    // the run ending after the position is the only candidate
+    const vector<int>::const_iterator endIter = upper_bound(ends.begin(), ends.end(), position);
+    if ( endIter != ends.end() && starts[endIter - ends.begin()] <= position )
+        return (int)(endIter - ends.begin());
+    return -1;
+}
+
+void PackedReference::PackedReferencePrivate::InitializeTables(void) {
+
+    // N.B. - called once, through pthread_once()
+    static const char Bases[4] = { 'A', 'C', 'G', 'T' };
+    for ( int c = 0; c < 256; ++c )
+        EncodeTable[c] = CodeN;
+    for ( int code = 0; code < 4; ++code ) {
+        EncodeTable[(uint8_t)Bases[code]] = code;
+        EncodeTable[(uint8_t)tolower(Bases[code])] = code;
+    }
+
+    for ( int byte = 0; byte < 256; ++byte ) {
+        for ( int i = 0; i < 4; ++i )
+            DecodeTable[byte][i] = Bases[ (byte >> (2*i)) & 3 ];
+    }
+}
+
+bool PackedReference::PackedReferencePrivate::LoadContig(const int refId) {
+
+    PackedContig& contig = Contigs[refId];
+    const int length = Lengths[refId];
+
+    // make room first
+    const size_t packedLength = ((size_t)length + 3) / 4;
+    EvictContigs(packedLength);
+
+    // pack sequence a chunk at a time, any character other than ACGT packed as A & recorded in runs
+    contig.Bases.assign(packedLength, 0);
+    contig.RunStarts.clear();
+    contig.RunEnds.clear();
+    contig.RunBases.clear();
+    contig.LowerStarts.clear();
+    contig.LowerEnds.clear();
+    string chunk;
+    for ( int chunkStart = 0; chunkStart < length; chunkStart += LoadChunkLength ) {
+        const int chunkEnd = min(chunkStart + LoadChunkLength, length);
+        if ( !Reference.GetSequence(refId, chunkStart, chunkEnd - 1, chunk) || (int)chunk.size() != chunkEnd - chunkStart ) {
+            contig.Bases.clear();
+            SetErrorString("PackedReference::LoadContig() : could not read sequence of " + Names[refId]);
+            return false;
+        }
+
+        for ( int i = 0; i < (int)chunk.size(); ++i ) {
+            const int position = chunkStart + i;
+            const char base = chunk[i];
+            const uint8_t code = EncodeTable[(uint8_t)base];
+            if ( code == CodeN ) {
+                if ( contig.RunEnds.empty() || contig.RunEnds.back() != position || contig.RunBases.back() != base ) {
+                    contig.RunStarts.push_back(position);
+                    contig.RunEnds.push_back(position);
+                    contig.RunBases.push_back(base);
+                }
+                ++contig.RunEnds.back();
+                continue;
+            }
+
+            contig.Bases[position >> 2] |= ( code << (2*(position & 3)) );
+            if ( islower(base) ) {
+                if ( contig.LowerEnds.empty() || contig.LowerEnds.back() != position ) {
+                    contig.LowerStarts.push_back(position);
+                    contig.LowerEnds.push_back(position);
+                }
+                ++contig.LowerEnds.back();
+            }
+        }
+    }
+
+    // N.B. - release any slack capacity of the run vectors
+    vector<int>(contig.RunStarts).swap(contig.RunStarts);
+    vector<int>(contig.RunEnds).swap(contig.RunEnds);
+    vector<char>(contig.RunBases).swap(contig.RunBases);
+    vector<int>(contig.LowerStarts).swap(contig.LowerStarts);
+    vector<int>(contig.LowerEnds).swap(contig.LowerEnds);
+
+    contig.IsLoaded = true;
+    RecentContigs.push_front(refId);
+    contig.RecentIter = RecentContigs.begin();
+    UsedMemory += contig.GetMemory();
+    return true;
+}
+
+bool PackedReference::PackedReferencePrivate::Open(const string& filename, const string& indexFilename) {
+
+    Close();
+
+    pthread_mutex_lock(&Mutex);
+
+    // the index provides reference names & lengths
+    if ( indexFilename.empty() ) {
+        SetErrorString("PackedReference::Open() : an index is required for " + filename);
+        pthread_mutex_unlock(&Mutex);
+        return false;
+    }
+    if ( !Reference.Open(filename, indexFilename, true) ) {
+        Reference.Close();
+        SetErrorString("PackedReference::Open() : could not open " + filename);
+        pthread_mutex_unlock(&Mutex);
+        return false;
+    }
+
+    IsOpen  = true;
+    Names   = Reference.GetReferenceNames();
+    Lengths = Reference.GetReferenceLengths();
+    Contigs.assign(Names.size(), PackedContig());
+    pthread_mutex_unlock(&Mutex);
+    return true;
+}
+
+const PackedReference::PackedReferencePrivate::PackedContig*
+PackedReference::PackedReferencePrivate::PinContig(const int refId) {
+
+    pthread_mutex_lock(&Mutex);
+
+    if ( refId < 0 || refId >= (int)Contigs.size() ) {
+        stringstream s("");
+        s << "PackedReference : invalid reference id: " << refId;
+        SetErrorString(s.str());
+        pthread_mutex_unlock(&Mutex);
+        return 0;
+    }
+
+    // load reference on first use, otherwise mark as most recently used
+    PackedContig& contig = Contigs[refId];
+    if ( !contig.IsLoaded ) {
+        if ( !LoadContig(refId) ) {
+            pthread_mutex_unlock(&Mutex);
+            return 0;
+        }
+    }
+    else
+        RecentContigs.splice(RecentContigs.begin(), RecentContigs, contig.RecentIter);
+
+    // N.B. - a pinned reference is never evicted, so it may be read once the lock is released
+    ++contig.PinCount;
+    pthread_mutex_unlock(&Mutex);
+    return &contig;
+}
+
+void PackedReference::PackedReferencePrivate::SetErrorString(const string& message) {
+    // N.B. - only called with the mutex held
+    ErrorString = message;
+}
+
+void PackedReference::PackedReferencePrivate::UnloadContig(const int refId) {
+
+    PackedContig& contig = Contigs[refId];
+    UsedMemory -= contig.GetMemory();
+    RecentContigs.erase(contig.RecentIter);
+
+    // N.B. - swap with empty vectors to actually release memory
+    vector<uint8_t>().swap(contig.Bases);
+    vector<int>().swap(contig.RunStarts);
+    vector<int>().swap(contig.RunEnds);
+    vector<char>().swap(contig.RunBases);
+    vector<int>().swap(contig.LowerStarts);
+    vector<int>().swap(contig.LowerEnds);
+    contig.IsLoaded = false;
+}
+
+void PackedReference::PackedReferencePrivate::UnpinContig(const int refId) {
+    pthread_mutex_lock(&Mutex);
+    --Contigs[refId].PinCount;
+    pthread_mutex_unlock(&Mutex);
+}
+
+// ---------------------------------------------
+// PackedReference implementation
+
+PackedReference::PackedReference(void)
+    : d( new PackedReferencePrivate )
+{ }
+
+PackedReference::~PackedReference(void) {
+    delete d;
+    d = 0;
+}
+
+void PackedReference::Close(void) {
+    d->Close();
+}
+
+bool PackedReference::GetBases(const int refId, const vector<int>& positions, string& bases) {
+    return d->GetBases(refId, positions, bases);
+}
+
+const string& PackedReference::GetErrorString(void) const {
+    return d->ErrorString;
+}
+
+vector<int> PackedReference::GetReferenceLengths(void) const {
+    return d->Lengths;
+}
+
+vector<string> PackedReference::GetReferenceNames(void) const {
+    return d->Names;
+}
+
+size_t PackedReference::GetUsedMemory(void) const {
+    pthread_mutex_lock(&d->Mutex);
+    const size_t usedMemory = d->UsedMemory;
+    pthread_mutex_unlock(&d->Mutex);
+    return usedMemory;
+}
+
+bool PackedReference::GetWindow(const int refId, const int start, const int length, string& sequence) {
+    return d->GetWindow(refId, start, length, sequence);
+}
+
+bool PackedReference::Open(const string& filename, const string& indexFilename) {
+    return d->Open(filename, indexFilename);
+}
+
+void PackedReference::SetMemoryBudget(const size_t budget) {
+    pthread_mutex_lock(&d->Mutex);
+    d->MemoryBudget = budget;
+    pthread_mutex_unlock(&d->Mutex);
+}
@@ -0,0 +1,57 @@
+// ***************************************************************************
+// bamtools_packed_reference.h (c) 2010 Derek Barnett, Erik Garrison
+// Marth Lab, Department of Biology, Boston College
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Provides an in-memory, 2-bit packed copy of reference sequences.
+// ***************************************************************************
+
+#ifndef BAMTOOLS_PACKED_REFERENCE_H
+#define BAMTOOLS_PACKED_REFERENCE_H
+
+#include "utils/utils_global.h"
+#include <string>
+#include <vector>
+
+namespace BamTools {
+
+// holds references read from an indexed FASTA file, 2 bits per base plus runs of any other
+// characters (N, IUPAC codes) & of lower case bases, loading each reference on first use &
+// evicting the least recently used over the memory budget
+//
+// N.B. - bases are returned exactly as in the FASTA file
+//        lookups may be made from any number of threads at once: the lock is only held to load a
+//        reference or pin it in memory, bases are decoded without it
+class UTILS_EXPORT PackedReference {
+
+    public:
+        PackedReference(void);
+        ~PackedReference(void);
+
+    public:
+        void Close(void);
+        bool Open(const std::string& filename, const std::string& indexFilename);
+
+        // bases at each of 'positions', 'N' past the reference end
+        bool GetBases(const int refId, const std::vector<int>& positions, std::string& bases);
+        // 'length' bases from 'start', clipped to the reference end
+        bool GetWindow(const int refId, const int start, const int length, std::string& sequence);
+
+        const std::string& GetErrorString(void) const;
+        std::vector<int> GetReferenceLengths(void) const;
+        std::vector<std::string> GetReferenceNames(void) const;
+        size_t GetUsedMemory(void) const;
+
+        // bytes of packed references kept in memory, 0 (the default) for no limit
+        // N.B. - a reference larger than the budget is still loaded, on its own
+        void SetMemoryBudget(const size_t budget);
+
+    private:
+        struct PackedReferencePrivate;
+        PackedReferencePrivate* d;
+};
+
+} // namespace BamTools
+
+#endif // BAMTOOLS_PACKED_REFERENCE_H
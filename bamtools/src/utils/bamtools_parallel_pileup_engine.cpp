@@ -0,0 +1,550 @@
+// ***************************************************************************
+// bamtools_parallel_pileup_engine.cpp (c) 2010 Derek Barnett, Erik Garrison
+// Marth Lab, Department of Biology, Boston College
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Provides pileups of genome tiles computed on a pool of worker threads.
+// ***************************************************************************
+
+#include "utils/bamtools_parallel_pileup_engine.h"
+#include <api/BamReader.h>
+using namespace BamTools;
+
+#include <pthread.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+using namespace std;
+
+// ---------------------------------------------
+// ParallelPileupEnginePrivate implementation
+
+struct ParallelPileupEngine::ParallelPileupEnginePrivate {
+
+    // constants
+    static const int TilesPerThread = 8;           // several tiles per thread to even out the load
+
+    // settings
+    int NumThreads;
+    DeliveryMode Mode;
+    PileupFilter Filter;
+    bool IsCoreOnly;
+    int LookbackLength;
+    bool HasRegions;
+    vector<PileupTile> Regions;
+    string ErrorString;
+
+    // state of the current run
+    string BamFilename;
+    ParallelPileupVisitor* Visitor;
+    vector<PileupTile> Tiles;
+    vector<pthread_t> Threads;
+
+    // shared state of the current run, guarded by the mutex
+    // N.B. - results are held per tile when delivering in tile order, per worker otherwise
+    vector<PileupVisitor*> Results;
+    vector<bool> IsComplete;
+    int NextTile;
+    int NextDelivery;
+    int NextWorker;
+    bool IsStopped;
+    string WorkerError;
+
+    pthread_mutex_t Mutex;
+    pthread_cond_t TileComplete;
+    pthread_cond_t TileDelivered;
+
+    // ctor & dtor
+    ParallelPileupEnginePrivate(const int numThreads)
+        : NumThreads(max(numThreads, 1))
+        , Mode(ParallelPileupEngine::InTileOrder)
+        , IsCoreOnly(false)
+        , LookbackLength(PileupEngine::DefaultLookbackLength)
+        , HasRegions(false)
+        , Visitor(0)
+        , NextTile(0)
+        , NextDelivery(0)
+        , NextWorker(0)
+        , IsStopped(false)
+    {
+        pthread_mutex_init(&Mutex, 0);
+        pthread_cond_init(&TileComplete, 0);
+        pthread_cond_init(&TileDelivered, 0);
+    }
+
+    ~ParallelPileupEnginePrivate(void) {
+        pthread_cond_destroy(&TileDelivered);
+        pthread_cond_destroy(&TileComplete);
+        pthread_mutex_destroy(&Mutex);
+    }
+
+    // 'public' methods
+    bool Run(const string& bamFilename, ParallelPileupVisitor* visitor);
+
+    // internal methods
+    private:
+        int ClaimTile(void);
+        PileupVisitor* CreateVisitor(void);
+        void DeleteResults(void);
+        void DeliverInTileOrder(void);
+        void DeliverPerThread(void);
+        void JoinWorkers(void);
+        bool RunTile(BamReader& reader, const PileupTile& tile, PileupVisitor* visitor);
+        void RunWorker(void);
+        void SetWorkerError(const string& message);
+        bool StartWorkers(void);
+        void Stop(void);
+        static void* WorkerMain(void* engine);
+};
+
+const int ParallelPileupEngine::ParallelPileupEnginePrivate::TilesPerThread;
+
+bool ParallelPileupEngine::ParallelPileupEnginePrivate::Run(const string& bamFilename,
+                                                            ParallelPileupVisitor* visitor)
+{
+    ErrorString.clear();
+
+    // read reference data, workers open their own readers
+    BamReader reader;
+    if ( !reader.Open(bamFilename) ) {
+        ErrorString = "ParallelPileupEngine::Run() : could not open BAM file: " + bamFilename;
+        return false;
+    }
+    const RefVector references = reader.GetReferenceData();
+    reader.Close();
+
+    // all references, unless regions were requested
+    vector<PileupTile> regions = Regions;
+    if ( !HasRegions ) {
+        regions.clear();
+        for ( int refId = 0; refId < (int)references.size(); ++refId )
+            regions.push_back( PileupTile(refId, 0, references[refId].RefLength) );
+    }
+
+    // reset run state
+    BamFilename = bamFilename;
+    Visitor     = visitor;
+    Tiles       = ParallelPileupEngine::CreateTiles(bamFilename + ".bai", references, regions, NumThreads * TilesPerThread);
+    Results.assign( (Mode == ParallelPileupEngine::InTileOrder) ? Tiles.size() : NumThreads, (PileupVisitor*)0 );
+    IsComplete.assign(Tiles.size(), false);
+    NextTile     = 0;
+    NextDelivery = 0;
+    NextWorker   = 0;
+    IsStopped    = false;
+    WorkerError.clear();
+
+    if ( !StartWorkers() ) {
+        Stop();
+        DeleteResults();
+        ErrorString = "ParallelPileupEngine::Run() : could not start worker threads";
+        return false;
+    }
+
+    // workers must be stopped before an exception thrown by a visitor leaves
+    try {
+        if ( Mode == ParallelPileupEngine::InTileOrder )
+            DeliverInTileOrder();
+        else
+            DeliverPerThread();
+    }
+    catch ( ... ) {
+        Stop();
+        DeleteResults();
+        throw;
+    }
+
+    Stop();
+    DeleteResults();
+
+    if ( !WorkerError.empty() ) {
+        ErrorString = WorkerError;
+        return false;
+    }
+    return true;
+}
+
+int ParallelPileupEngine::ParallelPileupEnginePrivate::ClaimTile(void) {
+
+    pthread_mutex_lock(&Mutex);
+
+    // when delivering in tile order, wait while too many tiles are waiting for delivery
+    const int maxTilesInFlight = 2 * NumThreads;
+    while ( Mode == ParallelPileupEngine::InTileOrder &&
+            !IsStopped &&
+            NextTile < (int)Tiles.size() &&
+            NextTile >= NextDelivery + maxTilesInFlight )
+    {
+        pthread_cond_wait(&TileDelivered, &Mutex);
+    }
+
+    int tileIndex = -1;
+    if ( !IsStopped && NextTile < (int)Tiles.size() )
+        tileIndex = NextTile++;
+
+    pthread_mutex_unlock(&Mutex);
+    return tileIndex;
+}
+
+PileupVisitor* ParallelPileupEngine::ParallelPileupEnginePrivate::CreateVisitor(void) {
+    pthread_mutex_lock(&Mutex);
+    PileupVisitor* visitor = Visitor->CreateVisitor();
+    pthread_mutex_unlock(&Mutex);
+    return visitor;
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::DeleteResults(void) {
+    vector<PileupVisitor*>::iterator resultIter = Results.begin();
+    vector<PileupVisitor*>::iterator resultEnd  = Results.end();
+    for ( ; resultIter != resultEnd; ++resultIter ) {
+        delete (*resultIter);
+        (*resultIter) = 0;
+    }
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::DeliverInTileOrder(void) {
+
+    for ( int tileIndex = 0; tileIndex < (int)Tiles.size(); ++tileIndex ) {
+
+        // wait for tile, unless a worker failed
+        pthread_mutex_lock(&Mutex);
+        while ( !IsComplete[tileIndex] && !IsStopped )
+            pthread_cond_wait(&TileComplete, &Mutex);
+        if ( !IsComplete[tileIndex] ) {
+            pthread_mutex_unlock(&Mutex);
+            return;
+        }
+
+        // take tile's visitor, letting workers move on
+        PileupVisitor* tileVisitor = Results[tileIndex];
+        Results[tileIndex] = 0;
+        NextDelivery = tileIndex + 1;
+        pthread_cond_broadcast(&TileDelivered);
+        pthread_mutex_unlock(&Mutex);
+
+        // merge outside the lock
+        try {
+            Visitor->MergeVisitor(tileVisitor);
+        }
+        catch ( ... ) {
+            delete tileVisitor;
+            throw;
+        }
+        delete tileVisitor;
+    }
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::DeliverPerThread(void) {
+
+    // wait for all workers
+    JoinWorkers();
+    if ( !WorkerError.empty() )
+        return;
+
+    // merge in worker order
+    for ( size_t workerIndex = 0; workerIndex < Results.size(); ++workerIndex ) {
+        if ( Results[workerIndex] == 0 )
+            continue;
+        PileupVisitor* workerVisitor = Results[workerIndex];
+        Results[workerIndex] = 0;
+        try {
+            Visitor->MergeVisitor(workerVisitor);
+        }
+        catch ( ... ) {
+            delete workerVisitor;
+            throw;
+        }
+        delete workerVisitor;
+    }
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::JoinWorkers(void) {
+    vector<pthread_t>::const_iterator threadIter = Threads.begin();
+    vector<pthread_t>::const_iterator threadEnd  = Threads.end();
+    for ( ; threadIter != threadEnd; ++threadIter )
+        pthread_join(*threadIter, 0);
+    Threads.clear();
+}
+
+bool ParallelPileupEngine::ParallelPileupEnginePrivate::RunTile(BamReader& reader,
+                                                                const PileupTile& tile,
+                                                                PileupVisitor* visitor)
+{
+    // the engine only visits the tile's own positions, any earlier reads merely fill its window
+    BamRegion region(tile.RefId, tile.Start, tile.RefId, tile.End);
+    BamRegion readRegion = PileupEngine::GetReadRegion(region, LookbackLength);
+
+    PileupEngine pileup;
+    pileup.AddVisitor(visitor);
+    pileup.SetFilter(Filter);
+    pileup.SetRegion(region);
+    pileup.SetSkipGaps(true);
+
+    // a region without any indexed data has nothing to visit
+    if ( reader.SetRegion(readRegion) ) {
+        BamAlignment al;
+        while ( IsCoreOnly ? reader.GetNextAlignmentCore(al) : reader.GetNextAlignment(al) ) {
+            if ( !pileup.AddAlignment(al) ) {
+                SetWorkerError("ParallelPileupEngine::Run() : data not sorted correctly in BAM file: " + BamFilename);
+                return false;
+            }
+        }
+    }
+
+    pileup.Flush();
+    return true;
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::RunWorker(void) {
+
+    pthread_mutex_lock(&Mutex);
+    const int workerIndex = NextWorker++;
+    pthread_mutex_unlock(&Mutex);
+
+    PileupVisitor* workerVisitor = 0;
+    PileupVisitor* tileVisitor   = 0;
+
+    try {
+        BamReader reader;
+        if ( !reader.Open(BamFilename) || !reader.LocateIndex() ) {
+            SetWorkerError("ParallelPileupEngine::Run() : could not open BAM file and its index: " + BamFilename);
+            return;
+        }
+
+        int tileIndex;
+        while ( (tileIndex = ClaimTile()) >= 0 ) {
+
+            // one visitor per tile, or one for all tiles of this worker
+            tileVisitor = workerVisitor;
+            if ( tileVisitor == 0 ) {
+                tileVisitor = CreateVisitor();
+                if ( Mode == ParallelPileupEngine::PerThread )
+                    workerVisitor = tileVisitor;
+            }
+
+            const bool ok = RunTile(reader, Tiles[tileIndex], tileVisitor);
+
+            if ( !ok )
+                break;
+
+            // hand over the tile's visitor
+            if ( Mode == ParallelPileupEngine::InTileOrder ) {
+                pthread_mutex_lock(&Mutex);
+                Results[tileIndex] = tileVisitor;
+                IsComplete[tileIndex] = true;
+                pthread_cond_broadcast(&TileComplete);
+                pthread_mutex_unlock(&Mutex);
+                tileVisitor = 0;
+            }
+        }
+    }
+    catch ( const std::exception& e ) {
+        SetWorkerError(string("ParallelPileupEngine::Run() : ") + e.what());
+    }
+
+    // drop the visitor of a failed tile
+    if ( Mode == ParallelPileupEngine::InTileOrder )
+        delete tileVisitor;
+
+    // per-thread visitors are merged once all workers are done
+    if ( workerVisitor != 0 ) {
+        pthread_mutex_lock(&Mutex);
+        Results[workerIndex] = workerVisitor;
+        pthread_mutex_unlock(&Mutex);
+    }
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::SetWorkerError(const string& message) {
+    pthread_mutex_lock(&Mutex);
+    if ( WorkerError.empty() )
+        WorkerError = message;
+    IsStopped = true;
+    pthread_cond_broadcast(&TileComplete);
+    pthread_cond_broadcast(&TileDelivered);
+    pthread_mutex_unlock(&Mutex);
+}
+
+bool ParallelPileupEngine::ParallelPileupEnginePrivate::StartWorkers(void) {
+    for ( int threadIndex = 0; threadIndex < NumThreads; ++threadIndex ) {
+        pthread_t thread;
+        if ( pthread_create(&thread, 0, &ParallelPileupEnginePrivate::WorkerMain, this) != 0 )
+            return false;
+        Threads.push_back(thread);
+    }
+    return true;
+}
+
+void ParallelPileupEngine::ParallelPileupEnginePrivate::Stop(void) {
+    pthread_mutex_lock(&Mutex);
+    IsStopped = true;
+    pthread_cond_broadcast(&TileDelivered);
+    pthread_mutex_unlock(&Mutex);
+    JoinWorkers();
+}
+
+void* ParallelPileupEngine::ParallelPileupEnginePrivate::WorkerMain(void* engine) {
+    static_cast<ParallelPileupEnginePrivate*>(engine)->RunWorker();
+    return 0;
+}
+
+// ---------------------------------------------
+// ParallelPileupEngine implementation
+
+ParallelPileupEngine::ParallelPileupEngine(const int numThreads)
+    : d( new ParallelPileupEnginePrivate(numThreads) )
+{ }
+
+ParallelPileupEngine::~ParallelPileupEngine(void) {
+    delete d;
+    d = 0;
+}
+
+const string& ParallelPileupEngine::GetErrorString(void) const {
+    return d->ErrorString;
+}
+
+bool ParallelPileupEngine::Run(const string& bamFilename, ParallelPileupVisitor* visitor) {
+    return d->Run(bamFilename, visitor);
+}
+
+void ParallelPileupEngine::SetCoreAlignmentsOnly(const bool coreOnly) {
+    d->IsCoreOnly = coreOnly;
+}
+
+void ParallelPileupEngine::SetDeliveryMode(const DeliveryMode mode) {
+    d->Mode = mode;
+}
+
+void ParallelPileupEngine::SetFilter(const PileupFilter& filter) {
+    d->Filter = filter;
+}
+
+void ParallelPileupEngine::SetLookbackLength(const int length) {
+    d->LookbackLength = max(length, 0);
+}
+
+void ParallelPileupEngine::SetRegions(const vector<PileupTile>& regions) {
+    d->Regions = regions;
+    d->HasRegions = true;
+}
+
+bool ParallelPileupEngine::ReadLinearIndexWeights(const string& indexFilename,
+                                                  const int numReferences,
+                                                  vector<vector<double> >& weights)
+{
+    FILE* indexFile = fopen(indexFilename.c_str(), "rb");
+    if ( indexFile == 0 )
+        return false;
+
+    // check header
+    bool ok = true;
+    char magic[4];
+    int32_t numIndexReferences = 0;
+    ok &= ( fread(magic, 1, 4, indexFile) == 4 && memcmp(magic, "BAI\1", 4) == 0 );
+    ok &= ( fread(&numIndexReferences, sizeof(numIndexReferences), 1, indexFile) == 1 );
+    ok &= ( numIndexReferences == numReferences );
+
+    vector<vector<uint64_t> > offsets(numReferences);
+    for ( int refId = 0; ok && refId < numIndexReferences; ++refId ) {
+
+        // skip over bins & their chunks
+        int32_t numBins = 0;
+        ok &= ( fread(&numBins, sizeof(numBins), 1, indexFile) == 1 );
+        for ( int binIndex = 0; ok && binIndex < numBins; ++binIndex ) {
+            uint32_t bin = 0;
+            int32_t numChunks = 0;
+            ok &= ( fread(&bin, sizeof(bin), 1, indexFile) == 1 );
+            ok &= ( fread(&numChunks, sizeof(numChunks), 1, indexFile) == 1 );
+            ok &= ( fseeko(indexFile, (off_t)numChunks * 2 * sizeof(uint64_t), SEEK_CUR) == 0 );
+        }
+
+        // read linear offsets
+        int32_t numOffsets = 0;
+        ok &= ( fread(&numOffsets, sizeof(numOffsets), 1, indexFile) == 1 );
+        if ( ok && numOffsets > 0 ) {
+            offsets[refId].resize(numOffsets);
+            ok &= ( fread(&offsets[refId][0], sizeof(uint64_t), numOffsets, indexFile) == (size_t)numOffsets );
+        }
+    }
+
+    fclose(indexFile);
+    if ( !ok )
+        return false;
+
+    // window weight is the distance in compressed bytes to the next window with data,
+    // the last window of each reference is given the mean weight of that reference
+    weights.assign(numReferences, vector<double>());
+    for ( int refId = 0; refId < numReferences; ++refId ) {
+        const vector<uint64_t>& refOffsets = offsets[refId];
+        vector<double>& refWeights = weights[refId];
+        refWeights.assign(refOffsets.size(), 0.0);
+
+        double totalWeight = 0.0;
+        uint64_t nextOffset = 0;
+        for ( int windowIndex = (int)refOffsets.size() - 1; windowIndex >= 0; --windowIndex ) {
+            const uint64_t offset = refOffsets[windowIndex] >> 16;
+            if ( refOffsets[windowIndex] != 0 && nextOffset != 0 && nextOffset > offset ) {
+                refWeights[windowIndex] = (double)(nextOffset - offset);
+                totalWeight += refWeights[windowIndex];
+            }
+            if ( refOffsets[windowIndex] != 0 )
+                nextOffset = offset;
+        }
+
+        if ( !refWeights.empty() )
+            refWeights.back() = totalWeight / refWeights.size();
+    }
+
+    return true;
+}
+
+vector<PileupTile> ParallelPileupEngine::CreateTiles(const string& indexFilename,
+                                                     const RefVector& references,
+                                                     const vector<PileupTile>& regions,
+                                                     const int numTiles)
+{
+    static const int WindowShift   = 14;
+    static const int MaxTileLength = 1 << 18;
+
+    // every window costs at least a little, so uncovered stretches are also split
+    static const double MinWindowWeight = 1.0;
+
+    // fall back to weighting windows by length if the index is not a readable BAI
+    vector<vector<double> > weights;
+    if ( !ReadLinearIndexWeights(indexFilename, (int)references.size(), weights) )
+        weights.assign(references.size(), vector<double>());
+
+    double totalWeight = 0.0;
+    vector<PileupTile>::const_iterator regionIter = regions.begin();
+    vector<PileupTile>::const_iterator regionEnd  = regions.end();
+    for ( ; regionIter != regionEnd; ++regionIter ) {
+        const vector<double>& refWeights = weights[regionIter->RefId];
+        for ( int windowIndex = regionIter->Start >> WindowShift; windowIndex <= (regionIter->End - 1) >> WindowShift; ++windowIndex )
+            totalWeight += MinWindowWeight + ( (windowIndex < (int)refWeights.size()) ? refWeights[windowIndex] : 0.0 );
+    }
+
+    const double tileWeight = totalWeight / max(numTiles, 1);
+
+    vector<PileupTile> tiles;
+    for ( regionIter = regions.begin(); regionIter != regionEnd; ++regionIter ) {
+        const vector<double>& refWeights = weights[regionIter->RefId];
+
+        PileupTile tile(regionIter->RefId, regionIter->Start, regionIter->Start);
+        double weight = 0.0;
+        while ( tile.End < regionIter->End ) {
+            const int windowIndex = tile.End >> WindowShift;
+
+            weight += MinWindowWeight + ( (windowIndex < (int)refWeights.size()) ? refWeights[windowIndex] : 0.0 );
+            tile.End = min( (windowIndex + 1) << WindowShift, regionIter->End );
+
+            if ( weight >= tileWeight || tile.End - tile.Start >= MaxTileLength || tile.End == regionIter->End ) {
+                tiles.push_back(tile);
+                tile.Start = tile.End;
+                weight = 0.0;
+            }
+        }
+    }
+
+    return tiles;
+}
@@ -0,0 +1,108 @@
+// ***************************************************************************
+// bamtools_parallel_pileup_engine.h (c) 2010 Derek Barnett, Erik Garrison
+// Marth Lab, Department of Biology, Boston College
+// ---------------------------------------------------------------------------
+// Last modified: 17 October 2026
+// ---------------------------------------------------------------------------
+// Provides pileups of genome tiles computed on a pool of worker threads.
+// ***************************************************************************
+
+#ifndef BAMTOOLS_PARALLEL_PILEUP_ENGINE_H
+#define BAMTOOLS_PARALLEL_PILEUP_ENGINE_H
+
+#include "utils/utils_global.h"
+#include "utils/bamtools_pileup_engine.h"
+
+#include <api/BamAux.h>
+#include <string>
+#include <vector>
+
+namespace BamTools {
+
+// interval of one reference, 0-based & half-open
+struct UTILS_EXPORT PileupTile {
+
+    // data members
+    int RefId;
+    int Start;
+    int End;
+
+    // ctor
+    PileupTile(const int refId = -1, const int start = 0, const int end = 0)
+        : RefId(refId)
+        , Start(start)
+        , End(end)
+    { }
+};
+
+// supplies the visitors used by the workers & takes them back once they are done
+class UTILS_EXPORT ParallelPileupVisitor {
+
+    public:
+        ParallelPileupVisitor(void) { }
+        virtual ~ParallelPileupVisitor(void) { }
+
+    public:
+        // creates a visitor, called on a worker thread but never by two workers at once
+        virtual PileupVisitor* CreateVisitor(void) =0;
+
+        // receives a visitor after its last position, called on the thread running the engine
+        // N.B. - the engine deletes the visitor afterwards
+        virtual void MergeVisitor(PileupVisitor* visitor) =0;
+};
+
+// splits the requested regions into tiles of about equal compressed size, using the BAI
+// linear index, and runs a PileupEngine per tile, each with its own BamReader
+//
+// every position with aligned reads is visited exactly once: the reads straddling a tile
+// edge are read by both neighbouring tiles, but each tile only visits its own positions.
+// positions without any alignment are always skipped, and gaps only reported within tiles
+//
+// N.B. - each tile reads alignments from the lookback length before its start, see
+//        PileupEngine::GetReadRegion(). Reads starting further back than that are left out
+//        of the tile, which only happens for alignments (or spliced alignments) longer than
+//        the lookback; raise it with SetLookbackLength() for such data
+class UTILS_EXPORT ParallelPileupEngine {
+
+    // enums
+    public:
+        enum DeliveryMode { InTileOrder = 0 // one visitor per tile, merged in tile order
+                          , PerThread       // one visitor per worker, merged once all tiles are done
+                          };
+
+    public:
+        ParallelPileupEngine(const int numThreads = 1);
+        ~ParallelPileupEngine(void);
+
+    public:
+        const std::string& GetErrorString(void) const;
+        bool Run(const std::string& bamFilename, ParallelPileupVisitor* visitor);
+        // reads alignments without building their string fields, for visitors that only
+        // need the base & quality of each PileupRead
+        void SetCoreAlignmentsOnly(const bool coreOnly);
+        void SetDeliveryMode(const DeliveryMode mode);
+        void SetFilter(const PileupFilter& filter);
+        // distance before each tile from which its alignments are read, 16kb by default
+        void SetLookbackLength(const int length);
+        void SetRegions(const std::vector<PileupTile>& regions);
+
+    public:
+        // reads the compressed size of each 16kb window of each reference from a BAI linear index
+        static bool ReadLinearIndexWeights(const std::string& indexFilename,
+                                           const int numReferences,
+                                           std::vector<std::vector<double> >& weights);
+
+        // splits regions into 'numTiles' tiles of about equal weight, aligned to index windows
+        static std::vector<PileupTile> CreateTiles(const std::string& indexFilename,
+                                                   const RefVector& references,
+                                                   const std::vector<PileupTile>& regions,
+                                                   const int numTiles);
+
+    private:
+        struct ParallelPileupEnginePrivate;
+        ParallelPileupEnginePrivate* d;
+};
+
+} // namespace BamTools
+
+#endif // BAMTOOLS_PARALLEL_PILEUP_ENGINE_H
@@ -8,47 +8,300 @@
 // ***************************************************************************
 
 #include "utils/bamtools_pileup_engine.h"
+#include <api/BamConstants.h>
 using namespace BamTools;
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <list>
+#include <map>
+#include <queue>
 using namespace std;
 
+// ---------------------------------------------
+// PileupSequence implementation
+
+char PileupSequence::operator[](const int i) const {
+    const int32_t position = Offset + i;
+    if ( EncodedBases != 0 )
+        return Constants::BAM_DNA_LOOKUP[ (EncodedBases[position/2] >> (4*(1-(position%2)))) & 0xf ];
+    if ( Bases != 0 )
+        return (char)toupper(Bases[position]);
+    return 'N';
+}
+
+bool PileupSequence::operator==(const PileupSequence& other) const {
+    if ( Length != other.Length )
+        return false;
+    for ( int i = 0; i < Length; ++i ) {
+        if ( (*this)[i] != other[i] )
+            return false;
+    }
+    return true;
+}
+
+string PileupSequence::ToString(void) const {
+    string sequence(Length, 'N');
+    for ( int i = 0; i < Length; ++i )
+        sequence[i] = (*this)[i];
+    return sequence;
+}
+
+// ---------------------------------------------
+// PileupPositionBatch implementation
+
+void PileupPositionBatch::Append(const PileupPosition& pileupData) {
+
+    RefIds.push_back(pileupData.RefId);
+    Positions.push_back(pileupData.Position);
+    TotalDepths.push_back(pileupData.TotalDepth);
+
+    vector<PileupRead>::const_iterator readIter = pileupData.PileupReads.begin();
+    vector<PileupRead>::const_iterator readEnd  = pileupData.PileupReads.end();
+    for ( ; readIter != readEnd; ++readIter ) {
+        const PileupRead& pr = (*readIter);
+        const BamAlignment& al = *pr.Alignment;
+
+        // base & its quality, if any
+        const char base = ( pr.IsCurrentDeletion ? '*' : Constants::BAM_DNA_LOOKUP[pr.BaseCode] );
+        const uint8_t quality = ( pr.IsCurrentDeletion ? 0xFF : pr.BaseQuality );
+
+        uint8_t flags = 0;
+        if ( al.IsReverseStrand() ) flags |= ReverseStrand;
+        if ( pr.IsCurrentDeletion ) flags |= CurrentDeletion;
+        if ( pr.IsNextDeletion )    flags |= NextDeletion;
+        if ( pr.IsNextInsertion )   flags |= NextInsertion;
+        if ( pr.IsSegmentBegin )    flags |= SegmentBegin;
+        if ( pr.IsSegmentEnd )      flags |= SegmentEnd;
+        if ( pr.IsMateOverlap )     flags |= MateOverlap;
+        if ( pr.IsMateConflict )    flags |= MateConflict;
+
+        Bases.push_back(base);
+        Qualities.push_back(quality);
+        MapQualities.push_back( (uint8_t)min(al.MapQuality, (uint16_t)255) );
+        Flags.push_back(flags);
+        PositionsInAlignment.push_back(pr.PositionInAlignment);
+        DeletionLengths.push_back(pr.DeletionLength);
+        InsertionLengths.push_back(pr.InsertionLength);
+    }
+
+    ReadOffsets.push_back( (int)Bases.size() );
+}
+
+void PileupPositionBatch::Clear(void) {
+
+    // N.B. - clear() keeps capacity, so a reused batch stops allocating
+    RefIds.clear();
+    Positions.clear();
+    TotalDepths.clear();
+    ReadOffsets.assign(1, 0);
+    Bases.clear();
+    Qualities.clear();
+    MapQualities.clear();
+    Flags.clear();
+    PositionsInAlignment.clear();
+    DeletionLengths.clear();
+    InsertionLengths.clear();
+}
+
+// ---------------------------------------------
+// BatchPileupVisitorAdapter implementation
+
+void BatchPileupVisitorAdapter::Flush(void) {
+    if ( m_batch.Size() == 0 )
+        return;
+    m_visitor->VisitBatch(m_batch);
+    m_batch.Clear();
+}
+
+void BatchPileupVisitorAdapter::Visit(const PileupPosition& pileupData) {
+    m_batch.Append(pileupData);
+    if ( (int)m_batch.Size() >= m_batchSize )
+        Flush();
+}
+
 // ---------------------------------------------
 // PileupEnginePrivate implementation
 
 struct PileupEngine::PileupEnginePrivate {
+
+    // position of an alignment within its CIGAR operations, advanced with CurrentPosition
+    struct CigarCursor {
+
+        // data members
+        size_t OpIndex;           // first CIGAR op not entirely before CurrentPosition
+        int GenomePosition;       // reference position at the start of that op
+        int PositionInAlignment;  // query position at the start of that op
+        bool IsNewReadSegment;    // previous op (if any) begins a new read segment
+
+        // ctor
+        CigarCursor(const int position = 0)
+            : OpIndex(0)
+            , GenomePosition(position)
+            , PositionInAlignment(0)
+            , IsNewReadSegment(true)
+        { }
+    };
+
+    // alignment in the current window, with its cursor & (1-based) end position
+    struct ActiveAlignment {
+
+        // data members
+        BamAlignment Alignment;
+        CigarCursor Cursor;
+        int EndPosition;
+        const uint8_t* EncodedBases;        // into Alignment's own data, null if not read from a BAM file
+        const uint8_t* EncodedQualities;
+
+        // overlapping mates, only if merging them
+        uint64_t NameHash;
+        bool IsPendingMate;                 // waiting in PendingMates for its mate to arrive
+        ActiveAlignment* Mate;              // mate in the window, if paired up
+        int ReadIndex;                      // index into PileupReads at current position, -1 if none
+
+        // ctor
+        ActiveAlignment(void)
+            : EndPosition(0)
+            , EncodedBases(0)
+            , EncodedQualities(0)
+            , NameHash(0)
+            , IsPendingMate(false)
+            , Mate(0)
+            , ReadIndex(-1)
+        { }
+    };
+
+    // window alignments are kept in arrival order, nodes are moved between lists rather than copied
+    typedef list<ActiveAlignment> AlignmentList;
+
+    // leftmost mates overlapping their mate's start, by name hash
+    typedef multimap<uint64_t, AlignmentList::iterator> PendingMateMap;
+
+    // entry of the window ordered by end position
+    struct ExpiringAlignment {
+
+        // data members
+        int EndPosition;
+        AlignmentList::iterator Alignment;
+
+        // ctor
+        ExpiringAlignment(const int endPosition, const AlignmentList::iterator& alignment)
+            : EndPosition(endPosition)
+            , Alignment(alignment)
+        { }
+
+        // ordering for a min-heap on end position
+        bool operator<(const ExpiringAlignment& other) const {
+            return EndPosition > other.EndPosition;
+        }
+    };
   
     // data members
     int CurrentId;
     int CurrentPosition;
-    vector<BamAlignment> CurrentAlignments;
+    AlignmentList CurrentAlignments;
+    AlignmentList RetiredAlignments;
+    vector<ExpiringAlignment> ExpiringAlignments;
+    PendingMateMap PendingMates;
+    priority_queue<int, vector<int>, greater<int> > DroppedEndPositions;
+    uint64_t RandomState;
     PileupPosition CurrentPileupData;
     
     bool IsFirstAlignment;
     vector<PileupVisitor*> Visitors;
+    vector<BatchPileupVisitor*> BatchVisitors;
+    PileupPositionBatch CurrentBatch;
+    int BatchSize;
+
+    bool HasRegion;
+    BamRegion Region;
+
+    PileupFilter Filter;
+
+    bool HasSites;
+    vector<int> Sites;
+    size_t NextSite;
+
+    bool IsAggregatingInsertions;
+    bool IsCopyingAlignments;
+    bool IsSkippingGaps;
   
     // ctor & dtor
     PileupEnginePrivate(void)
         : CurrentId(-1)
         , CurrentPosition(-1)
+        , RandomState(0)
         , IsFirstAlignment(true)
+        , BatchSize(4096)
+        , HasRegion(false)
+        , HasSites(false)
+        , NextSite(0)
+        , IsAggregatingInsertions(false)
+        , IsCopyingAlignments(false)
+        , IsSkippingGaps(false)
     { }
     ~PileupEnginePrivate(void) { }
     
     // 'public' methods
     bool AddAlignment(const BamAlignment& al);
+    void AdvanceTo(const int refId, const int position);
     void Flush(void);
     
     // internal methods
     private:
+        void AggregateInsertions(void);
+        void ApplyGapVisitors(const int length);
         void ApplyVisitors(void);
+        void ApplyBatchVisitors(void);
         void ClearOldData(void);
+        void ClearWindow(void);
         void CreatePileupData(void);
-        void ParseAlignmentCigar(const BamAlignment& al);
+        void FlushReference(void);
+        static uint64_t HashName(const char* name);
+        bool IsAfterRegion(const int refId, const int position) const;
+        bool IsBeforeRegion(const int refId, const int position) const;
+        bool IsFiltered(const BamAlignment& al) const;
+        bool IsLowQualityBase(const PileupRead& pileupRead) const;
+        bool IsOverlapClipped(const BamAlignment& al) const;
+        bool IsWindowEmpty(void);
+        void MergeMateRead(ActiveAlignment& activeAlignment);
+        uint32_t NextRandom(void);
+        void PairMates(const AlignmentList::iterator& alIter);
+        void RetireAlignment(const AlignmentList::iterator& alIter);
+        AlignmentList::iterator StoreAlignment(const BamAlignment& al, const int endPosition);
+        void AddToWindow(const BamAlignment& al);
+        void AdvanceCursor(const BamAlignment& al, CigarCursor& cursor) const;
+        void ParseAlignmentCigar(ActiveAlignment& activeAlignment);
+        void ReadBase(const ActiveAlignment& activeAlignment, PileupRead& pileupRead) const;
+        void SetSequence(const ActiveAlignment& activeAlignment,
+                         const int32_t offset,
+                         const int length,
+                         PileupSequence& sequence) const;
+        void SiftExpiringAlignment(size_t index);
+        void SkipToRegion(const int position);
+        bool SkipToSite(const int position);
+        void VisitUpTo(const int position);
 };
 
 bool PileupEngine::PileupEnginePrivate::AddAlignment(const BamAlignment& al) {
   
+    // ignore alignments that fail the read filters
+    if ( IsFiltered(al) )
+        return true;
+
+    // ignore alignments that cannot overlap the region
+    if ( HasRegion ) {
+        if ( al.RefID < Region.LeftRefID || IsAfterRegion(al.RefID, al.Position) )
+            return true;
+
+        // alignments read from before the region start may also end before it
+        if ( IsBeforeRegion(al.RefID, al.Position) && al.GetEndPosition() <= Region.LeftPosition )
+            return true;
+    }
+
     // if first time
     if ( IsFirstAlignment ) {
       
@@ -57,8 +310,8 @@ bool PileupEngine::PileupEnginePrivate::AddAlignment(const BamAlignment& al) {
         CurrentPosition = al.Position;
         
         // store first entry
-        CurrentAlignments.clear();
-        CurrentAlignments.push_back(al);
+        ClearWindow();
+        AddToWindow(al);
         
         // set flag & return
         IsFirstAlignment = false;
@@ -70,7 +323,7 @@ bool PileupEngine::PileupEnginePrivate::AddAlignment(const BamAlignment& al) {
       
         // if same position, store and move on
         if ( al.Position == CurrentPosition )
-            CurrentAlignments.push_back(al);
+            AddToWindow(al);
         
         // if less than CurrentPosition - sorting error => ABORT
         else if ( al.Position < CurrentPosition ) {
@@ -80,11 +333,8 @@ bool PileupEngine::PileupEnginePrivate::AddAlignment(const BamAlignment& al) {
         
         // else print pileup data until 'catching up' to CurrentPosition
         else {
-            while ( al.Position > CurrentPosition ) {
-                ApplyVisitors();
-                ++CurrentPosition;
-            }
-            CurrentAlignments.push_back(al);
+            VisitUpTo(al.Position);
+            AddToWindow(al);
         }
     } 
 
@@ -98,21 +348,67 @@ bool PileupEngine::PileupEnginePrivate::AddAlignment(const BamAlignment& al) {
     else {
         
         // print any remaining pileup data from previous reference
-        while ( !CurrentAlignments.empty() ) {
-            ApplyVisitors();
-            ++CurrentPosition;
-        }
+        FlushReference();
         
-        // store first entry on this new reference, update markers
-        CurrentAlignments.clear();
-        CurrentAlignments.push_back(al);
+        // update markers, store first entry on this new reference
         CurrentId = al.RefID;
         CurrentPosition = al.Position;
+        ClearWindow();
+        AddToWindow(al);
     }
   
     return true;
 }
 
+void PileupEngine::PileupEnginePrivate::AdvanceTo(const int refId, const int position) {
+
+    // nothing to visit before the first alignment, or on earlier references
+    if ( IsFirstAlignment || refId < CurrentId )
+        return;
+
+    // print any remaining pileup data of a reference left behind
+    // N.B. - the window stays empty, so the next alignment simply starts the new reference
+    if ( refId > CurrentId ) {
+        FlushReference();
+        return;
+    }
+
+    // otherwise visit positions up to the given one, within the region
+    const int endPosition = ( IsAfterRegion(refId, position) ? Region.RightPosition : position );
+    if ( endPosition > CurrentPosition )
+        VisitUpTo(endPosition);
+}
+
+void PileupEngine::PileupEnginePrivate::AggregateInsertions(void) {
+
+    // count reads per distinct inserted sequence, few alleles are expected at any position
+    vector<PileupInsertion>& insertions = CurrentPileupData.Insertions;
+    vector<PileupRead>::const_iterator readIter = CurrentPileupData.PileupReads.begin();
+    vector<PileupRead>::const_iterator readEnd  = CurrentPileupData.PileupReads.end();
+    for ( ; readIter != readEnd; ++readIter ) {
+        const PileupRead& pr = (*readIter);
+        if ( !pr.IsNextInsertion || pr.InsertedBases.Length == 0 )
+            continue;
+
+        vector<PileupInsertion>::iterator insertionIter = insertions.begin();
+        vector<PileupInsertion>::iterator insertionEnd  = insertions.end();
+        while ( insertionIter != insertionEnd && !(insertionIter->Bases == pr.InsertedBases) )
+            ++insertionIter;
+        if ( insertionIter == insertionEnd )
+            insertionIter = insertions.insert(insertionEnd, PileupInsertion(pr.InsertedBases));
+        ++insertionIter->Count;
+    }
+}
+
+void PileupEngine::PileupEnginePrivate::ApplyGapVisitors(const int length) {
+
+    // notify all visitors of the positions skipped, starting at current position
+    vector<PileupVisitor*>::const_iterator visitorIter = Visitors.begin();
+    vector<PileupVisitor*>::const_iterator visitorEnd  = Visitors.end();
+    for ( ; visitorIter != visitorEnd; ++visitorIter )
+        (*visitorIter)->VisitGap(CurrentId, CurrentPosition, length);
+}
+
 void PileupEngine::PileupEnginePrivate::ApplyVisitors(void) {
   
     // parse CIGAR data in BamAlignments to build up current pileup data
@@ -123,6 +419,27 @@ void PileupEngine::PileupEnginePrivate::ApplyVisitors(void) {
     vector<PileupVisitor*>::const_iterator visitorEnd  = Visitors.end();
     for ( ; visitorIter != visitorEnd; ++visitorIter ) 
         (*visitorIter)->Visit(CurrentPileupData);
+
+    // add to batch, handing it over once full
+    if ( !BatchVisitors.empty() ) {
+        CurrentBatch.Append(CurrentPileupData);
+        if ( (int)CurrentBatch.Size() >= BatchSize )
+            ApplyBatchVisitors();
+    }
+}
+
+void PileupEngine::PileupEnginePrivate::ApplyBatchVisitors(void) {
+
+    if ( CurrentBatch.Size() == 0 )
+        return;
+
+    // apply all batch visitors to current batch
+    vector<BatchPileupVisitor*>::const_iterator visitorIter = BatchVisitors.begin();
+    vector<BatchPileupVisitor*>::const_iterator visitorEnd  = BatchVisitors.end();
+    for ( ; visitorIter != visitorEnd; ++visitorIter )
+        (*visitorIter)->VisitBatch(CurrentBatch);
+
+    CurrentBatch.Clear();
 }
 
 void PileupEngine::PileupEnginePrivate::ClearOldData(void) {
@@ -132,31 +449,23 @@ void PileupEngine::PileupEnginePrivate::ClearOldData(void) {
     //        while our CurrentPosition is 0-based. For example, an alignment with 'endPosition' of
     //        100 does not overlap a 'CurrentPosition' of 100, and should be discarded.
 
-    size_t i = 0;
-    size_t j = 0;
-    const size_t numAlignments = CurrentAlignments.size();
-    while ( i < numAlignments ) {
-
-        // skip over alignment if its (1-based) endPosition is <= to (0-based) CurrentPosition
-        // i.e. this entry will not be saved upon vector resize
-        const int endPosition = CurrentAlignments[i].GetEndPosition();
-        if ( endPosition <= CurrentPosition ) {
-            ++i;
-            continue;
-        }
-
-        // otherwise alignment ends after CurrentPosition
-        // move it towards vector beginning, at index j
-        if ( i != j )
-            CurrentAlignments[j] = CurrentAlignments[i];
-
-        // increment our indices
-        ++i;
-        ++j;
+    // retire alignments from the top of the heap, their nodes are kept for reuse
+    while ( !ExpiringAlignments.empty() && ExpiringAlignments.front().EndPosition <= CurrentPosition ) {
+        RetireAlignment(ExpiringAlignments.front().Alignment);
+        pop_heap(ExpiringAlignments.begin(), ExpiringAlignments.end());
+        ExpiringAlignments.pop_back();
     }
 
-    // 'squeeze' vector to size j, discarding all remaining alignments in the container
-    CurrentAlignments.resize(j);
+    // forget alignments left out by the depth cap the same way
+    while ( !DroppedEndPositions.empty() && DroppedEndPositions.top() <= CurrentPosition )
+        DroppedEndPositions.pop();
+}
+
+void PileupEngine::PileupEnginePrivate::ClearWindow(void) {
+    RetiredAlignments.splice(RetiredAlignments.end(), CurrentAlignments);
+    ExpiringAlignments.clear();
+    PendingMates.clear();
+    DroppedEndPositions = priority_queue<int, vector<int>, greater<int> >();
 }
 
 void PileupEngine::PileupEnginePrivate::CreatePileupData(void) {
@@ -167,171 +476,570 @@ void PileupEngine::PileupEnginePrivate::CreatePileupData(void) {
     // set pileup refId, position to current markers
     CurrentPileupData.RefId = CurrentId;
     CurrentPileupData.Position = CurrentPosition;
+    CurrentPileupData.TotalDepth = (int)( ExpiringAlignments.size() + DroppedEndPositions.size() );
+    CurrentPileupData.PileupReads.clear();
     CurrentPileupData.PileupAlignments.clear();
+    CurrentPileupData.Insertions.clear();
     
+    // forget the reads of the previous position, a mate later in the window is not parsed yet
+    // when its earlier mate looks it up
+    AlignmentList::iterator alIter = CurrentAlignments.begin();
+    AlignmentList::iterator alEnd  = CurrentAlignments.end(); 
+    if ( Filter.MergeOverlappingMates ) {
+        for ( ; alIter != alEnd; ++alIter )
+            alIter->ReadIndex = -1;
+        alIter = CurrentAlignments.begin();
+    }
+
     // parse CIGAR data in remaining alignments 
-    vector<BamAlignment>::const_iterator alIter = CurrentAlignments.begin();
-    vector<BamAlignment>::const_iterator alEnd  = CurrentAlignments.end(); 
-    for ( ; alIter != alEnd; ++alIter )
+    for ( ; alIter != alEnd; ++alIter ) {
         ParseAlignmentCigar( (*alIter) );
+
+        // fold the read into its mate's, if both cover current position
+        // N.B. - a mate is paired up when the later one arrives, so the earlier has already been parsed
+        if ( Filter.MergeOverlappingMates )
+            MergeMateRead( (*alIter) );
+    }
+
+    // count distinct insertion alleles
+    if ( IsAggregatingInsertions )
+        AggregateInsertions();
+
+    // copy alignments for visitors relying on the by-value records
+    if ( IsCopyingAlignments ) {
+        CurrentPileupData.PileupAlignments.reserve(CurrentPileupData.PileupReads.size());
+        vector<PileupRead>::const_iterator readIter = CurrentPileupData.PileupReads.begin();
+        vector<PileupRead>::const_iterator readEnd  = CurrentPileupData.PileupReads.end();
+        for ( ; readIter != readEnd; ++readIter )
+            CurrentPileupData.PileupAlignments.push_back( PileupAlignment(*readIter) );
+    }
 }
 
 void PileupEngine::PileupEnginePrivate::Flush(void) {
-    while ( !CurrentAlignments.empty() ) {
+    FlushReference();
+    ApplyBatchVisitors();
+}
+
+void PileupEngine::PileupEnginePrivate::FlushReference(void) {
+
+    // print pileup data until no alignments remain, the region ends or no sites remain
+    SkipToRegion(Region.LeftPosition);
+    while ( !(CurrentAlignments.empty() && DroppedEndPositions.empty()) &&
+            !IsAfterRegion(CurrentId, CurrentPosition) &&
+            SkipToSite(numeric_limits<int>::max()) )
+    {
+        if ( IsSkippingGaps && IsWindowEmpty() )
+            break;
         ApplyVisitors();
         ++CurrentPosition;
     }
+
+    // discard any alignments past the region, sites start over on the next reference
+    ClearWindow();
+    NextSite = 0;
+}
+
+uint64_t PileupEngine::PileupEnginePrivate::HashName(const char* name) {
+
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for ( ; *name != '\0'; ++name ) {
+        hash ^= (uint8_t)(*name);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool PileupEngine::PileupEnginePrivate::IsAfterRegion(const int refId, const int position) const {
+
+    // N.B. - like BamReader regions, the right bound is exclusive
+    if ( !HasRegion || !Region.isRightBoundSpecified() )
+        return false;
+    return ( refId > Region.RightRefID ||
+             (refId == Region.RightRefID && position >= Region.RightPosition) );
+}
+
+bool PileupEngine::PileupEnginePrivate::IsFiltered(const BamAlignment& al) const {
+    return ( al.MapQuality < Filter.MinMapQuality ||
+             (al.AlignmentFlag & Filter.RequiredFlags) != Filter.RequiredFlags ||
+             (al.AlignmentFlag & Filter.FilteredFlags) != 0 );
+}
+
+bool PileupEngine::PileupEnginePrivate::IsLowQualityBase(const PileupRead& pileupRead) const {
+
+    // N.B. - bases without a stored quality are kept
+    return ( pileupRead.BaseQuality != 0xFF && (int)pileupRead.BaseQuality < Filter.MinBaseQuality );
+}
+
+bool PileupEngine::PileupEnginePrivate::IsOverlapClipped(const BamAlignment& al) const {
+
+    // the leftmost mate of an overlapping pair defers to its mate, from the mate's start
+    // up to the fragment end implied by the insert size
+    return ( Filter.ClipOverlaps &&
+             al.IsPaired() &&
+             al.IsMateMapped() &&
+             al.MateRefID == al.RefID &&
+             al.InsertSize > 0 &&
+             al.MatePosition >= al.Position &&
+             !(al.MatePosition == al.Position && al.IsFirstMate()) &&
+             CurrentPosition >= al.MatePosition &&
+             CurrentPosition < al.Position + al.InsertSize );
+}
+
+bool PileupEngine::PileupEnginePrivate::IsWindowEmpty(void) {
+
+    // drop alignments ending before current position first
+    ClearOldData();
+    return ( CurrentAlignments.empty() && DroppedEndPositions.empty() );
+}
+
+uint32_t PileupEngine::PileupEnginePrivate::NextRandom(void) {
+
+    // 64-bit LCG (Knuth's MMIX constants), the high bits are the best distributed
+    RandomState = RandomState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(RandomState >> 32);
+}
+
+bool PileupEngine::PileupEnginePrivate::IsBeforeRegion(const int refId, const int position) const {
+    if ( !HasRegion || !Region.isLeftBoundSpecified() )
+        return false;
+    return ( refId < Region.LeftRefID ||
+             (refId == Region.LeftRefID && position < Region.LeftPosition) );
+}
+
+void PileupEngine::PileupEnginePrivate::AddToWindow(const BamAlignment& al) {
+
+    // calculate end position once
+    const int endPosition = al.GetEndPosition();
+
+    // below the depth cap, simply store alignment
+    if ( Filter.MaxDepth > 0 )
+        ClearOldData();
+    if ( Filter.MaxDepth <= 0 || (int)ExpiringAlignments.size() < Filter.MaxDepth ) {
+        AlignmentList::iterator alIter = StoreAlignment(al, endPosition);
+        ExpiringAlignments.push_back( ExpiringAlignment(endPosition, alIter) );
+        push_heap(ExpiringAlignments.begin(), ExpiringAlignments.end());
+        return;
+    }
+
+    // otherwise keep it with probability MaxDepth / total depth (reservoir sampling),
+    // in place of a random stored alignment
+    const size_t totalDepth  = ExpiringAlignments.size() + DroppedEndPositions.size() + 1;
+    const size_t sampleIndex = NextRandom() % totalDepth;
+    if ( sampleIndex >= (size_t)Filter.MaxDepth ) {
+        DroppedEndPositions.push(endPosition);
+        return;
+    }
+
+    // N.B. - heap entries are in no particular order, so any index picks a random alignment
+    ExpiringAlignment& replaced = ExpiringAlignments[sampleIndex];
+    DroppedEndPositions.push(replaced.EndPosition);
+    RetireAlignment(replaced.Alignment);
+    replaced = ExpiringAlignment(endPosition, StoreAlignment(al, endPosition));
+    SiftExpiringAlignment(sampleIndex);
+}
+
+PileupEngine::PileupEnginePrivate::AlignmentList::iterator
+PileupEngine::PileupEnginePrivate::StoreAlignment(const BamAlignment& al, const int endPosition) {
+
+    // reuse a retired node if possible, its string storage included
+    if ( RetiredAlignments.empty() )
+        CurrentAlignments.push_back( ActiveAlignment() );
+    else
+        CurrentAlignments.splice(CurrentAlignments.end(), RetiredAlignments, RetiredAlignments.begin());
+
+    // store alignment & reset its cursor
+    AlignmentList::iterator alIter = --CurrentAlignments.end();
+    alIter->Alignment   = al;
+    alIter->Cursor      = CigarCursor(al.Position);
+    alIter->EndPosition = endPosition;
+    alIter->EncodedBases     = alIter->Alignment.GetEncodedQueryBases();
+    alIter->EncodedQualities = alIter->Alignment.GetEncodedQualities();
+    alIter->IsPendingMate = false;
+    alIter->Mate = 0;
+    alIter->ReadIndex = -1;
+
+    if ( Filter.MergeOverlappingMates )
+        PairMates(alIter);
+    return alIter;
+}
+
+void PileupEngine::PileupEnginePrivate::PairMates(const AlignmentList::iterator& alIter) {
+
+    const BamAlignment& al = alIter->Alignment;
+    if ( !al.IsPaired() || !al.IsMateMapped() || al.MateRefID != al.RefID )
+        return;
+
+    // hash the read name, BAM-encoded if possible
+    const char* name = al.GetEncodedName();
+    if ( name == 0 )
+        name = al.Name.c_str();
+    alIter->NameHash = HashName(name);
+
+    // pair up with a waiting mate, names are only compared on a matching hash
+    pair<PendingMateMap::iterator, PendingMateMap::iterator> range = PendingMates.equal_range(alIter->NameHash);
+    for ( PendingMateMap::iterator pendingIter = range.first; pendingIter != range.second; ++pendingIter ) {
+        ActiveAlignment& mate = *(pendingIter->second);
+        const BamAlignment& mateAl = mate.Alignment;
+        if ( mateAl.Position != al.MatePosition ||
+             mateAl.MatePosition != al.Position ||
+             mateAl.IsFirstMate() == al.IsFirstMate() )
+        {
+            continue;
+        }
+
+        const char* mateName = mateAl.GetEncodedName();
+        if ( mateName == 0 )
+            mateName = mateAl.Name.c_str();
+        if ( strcmp(name, mateName) != 0 )
+            continue;
+
+        mate.IsPendingMate = false;
+        mate.Mate = &(*alIter);
+        alIter->Mate = &mate;
+        PendingMates.erase(pendingIter);
+        return;
+    }
+
+    // otherwise wait for the mate, if it starts before this alignment ends
+    if ( al.MatePosition >= al.Position && al.MatePosition < alIter->EndPosition ) {
+        alIter->IsPendingMate = true;
+        PendingMates.insert( make_pair(alIter->NameHash, alIter) );
+    }
+}
+
+void PileupEngine::PileupEnginePrivate::RetireAlignment(const AlignmentList::iterator& alIter) {
+
+    // unpair from its mate, or stop waiting for it
+    if ( alIter->Mate != 0 )
+        alIter->Mate->Mate = 0;
+    if ( alIter->IsPendingMate ) {
+        pair<PendingMateMap::iterator, PendingMateMap::iterator> range = PendingMates.equal_range(alIter->NameHash);
+        for ( PendingMateMap::iterator pendingIter = range.first; pendingIter != range.second; ++pendingIter ) {
+            if ( pendingIter->second == alIter ) {
+                PendingMates.erase(pendingIter);
+                break;
+            }
+        }
+    }
+
+    // keep node for reuse
+    RetiredAlignments.splice(RetiredAlignments.end(), CurrentAlignments, alIter);
 }
 
-void PileupEngine::PileupEnginePrivate::ParseAlignmentCigar(const BamAlignment& al) {
+void PileupEngine::PileupEnginePrivate::AdvanceCursor(const BamAlignment& al, CigarCursor& cursor) const {
+
+    // move past CIGAR ops that end before the current position
+    // N.B. - only MATCH, DELETION & REF_SKIP consume the reference here, others never cover a position
+    const size_t numCigarOps = al.CigarData.size();
+    while ( cursor.OpIndex < numCigarOps ) {
+        const CigarOp& op = al.CigarData[cursor.OpIndex];
+
+        // stop at op covering current position
+        const bool isReferenceOp = ( op.Type == 'M' || op.Type == 'D' || op.Type == 'N' );
+        if ( isReferenceOp && cursor.GenomePosition + (int)op.Length > CurrentPosition )
+            break;
+
+        // increment markers
+        if ( op.Type == 'M' ) {
+            cursor.GenomePosition      += op.Length;
+            cursor.PositionInAlignment += op.Length;
+        }
+        else if ( op.Type == 'D' || op.Type == 'N' )
+            cursor.GenomePosition += op.Length;
+        else if ( op.Type == 'I' || op.Type == 'S' )
+            cursor.PositionInAlignment += op.Length;
+
+        // check for beginning of new read segment
+        cursor.IsNewReadSegment = ( op.Type == 'N' || op.Type == 'S' || op.Type == 'H' );
+        ++cursor.OpIndex;
+    }
+}
+
+void PileupEngine::PileupEnginePrivate::MergeMateRead(ActiveAlignment& activeAlignment) {
+
+    ActiveAlignment* mate = activeAlignment.Mate;
+    if ( activeAlignment.ReadIndex < 0 || mate == 0 || mate->ReadIndex < 0 )
+        return;
+
+    // keep the read with the higher quality base, the mate's on a tie
+    // N.B. - deletions & bases without a stored quality count as quality 0
+    vector<PileupRead>& reads = CurrentPileupData.PileupReads;
+    PileupRead& mateRead = reads[mate->ReadIndex];
+    const PileupRead& read = reads.back();
+    const int quality     = ( read.IsCurrentDeletion || read.BaseQuality == 0xFF ) ? 0 : read.BaseQuality;
+    const int mateQuality = ( mateRead.IsCurrentDeletion || mateRead.BaseQuality == 0xFF ) ? 0 : mateRead.BaseQuality;
+    const bool isConflict = ( read.IsCurrentDeletion != mateRead.IsCurrentDeletion ||
+                              (!read.IsCurrentDeletion && read.BaseCode != mateRead.BaseCode) );
+    if ( quality > mateQuality )
+        mateRead = read;
+    mateRead.IsMateOverlap  = true;
+    mateRead.IsMateConflict = isConflict;
+
+    // one read per fragment
+    reads.pop_back();
+    activeAlignment.ReadIndex = -1;
+}
+
+void PileupEngine::PileupEnginePrivate::ParseAlignmentCigar(ActiveAlignment& activeAlignment) {
   
+    const BamAlignment& al = activeAlignment.Alignment;
+    CigarCursor& cursor = activeAlignment.Cursor;
+
     // skip if unmapped
+    activeAlignment.ReadIndex = -1;
     if ( !al.IsMapped() ) return;
     
+    // move cursor up to the op covering current position
+    AdvanceCursor(al, cursor);
+
     // intialize local variables
-    int  genomePosition      = al.Position;
-    int  positionInAlignment = 0;
-    bool isNewReadSegment    = true;
-    bool saveAlignment       = true;    
-    PileupAlignment pileupAlignment(al);
+    const int genomePosition      = cursor.GenomePosition;
+    const int positionInAlignment = cursor.PositionInAlignment;
+    bool saveAlignment = true;
+    PileupRead pileupRead(&al);
     
-    // iterate over CIGAR operations
+    // if no op covers current position, store defaults
     const int numCigarOps = (const int)al.CigarData.size();
-    for (int i = 0; i < numCigarOps; ++i ) { 
+    const int i = (int)cursor.OpIndex;
+    if ( i < numCigarOps ) {
         const CigarOp& op = al.CigarData.at(i);
       
         // if op is MATCH
         if ( op.Type == 'M' ) {
           
-            // if match op overlaps current position
-            if ( genomePosition + (int)op.Length > CurrentPosition ) {
-              
-                // set pileup data
-                pileupAlignment.IsCurrentDeletion   = false;
-                pileupAlignment.IsNextDeletion      = false;
-                pileupAlignment.IsNextInsertion     = false;
-                pileupAlignment.PositionInAlignment = positionInAlignment + (CurrentPosition - genomePosition);
-                
-                // check for beginning of read segment
-                if ( genomePosition == CurrentPosition && isNewReadSegment ) 
-                    pileupAlignment.IsSegmentBegin = true;
+            // set pileup data
+            pileupRead.IsCurrentDeletion   = false;
+            pileupRead.IsNextDeletion      = false;
+            pileupRead.IsNextInsertion     = false;
+            pileupRead.PositionInAlignment = positionInAlignment + (CurrentPosition - genomePosition);
+            
+            // check for beginning of read segment, after any soft clip
+            if ( genomePosition == CurrentPosition && cursor.IsNewReadSegment ) {
+                pileupRead.IsSegmentBegin = true;
+                if ( i > 0 && al.CigarData.at(i-1).Type == 'S' ) {
+                    const int clipLength = (int)al.CigarData.at(i-1).Length;
+                    SetSequence(activeAlignment, positionInAlignment - clipLength, clipLength, pileupRead.LeadingSoftClip);
+                }
+            }
+            
+            // if we're at the end of a match operation
+            if ( genomePosition + (int)op.Length - 1 == CurrentPosition ) {
                 
-                // if we're at the end of a match operation
-                if ( genomePosition + (int)op.Length - 1 == CurrentPosition ) {
+                // if not last operation
+                if ( i < numCigarOps - 1 ) {
                     
-                    // if not last operation
-                    if ( i < numCigarOps - 1 ) {
-                        
-                        // check next CIGAR op
-                        const CigarOp& nextOp = al.CigarData.at(i+1);
-                        
-                        // if next CIGAR op is DELETION
-                        if ( nextOp.Type == 'D') {
-                            pileupAlignment.IsNextDeletion = true;
-                            pileupAlignment.DeletionLength = nextOp.Length;
-                        }
+                    // check next CIGAR op
+                    const CigarOp& nextOp = al.CigarData.at(i+1);
+                    
+                    // if next CIGAR op is DELETION
+                    if ( nextOp.Type == 'D') {
+                        pileupRead.IsNextDeletion = true;
+                        pileupRead.DeletionLength = nextOp.Length;
+                    }
+                    
+                    // if next CIGAR op is INSERTION
+                    else if ( nextOp.Type == 'I' ) {
+                        pileupRead.IsNextInsertion = true;
+                        pileupRead.InsertionLength = nextOp.Length;
+                        SetSequence(activeAlignment, pileupRead.PositionInAlignment + 1, nextOp.Length, pileupRead.InsertedBases);
+                    }
                         
-                        // if next CIGAR op is INSERTION
-                        else if ( nextOp.Type == 'I' ) {
-                            pileupAlignment.IsNextInsertion = true;
-                            pileupAlignment.InsertionLength = nextOp.Length;
-                        }
+                    // if next CIGAR op is either DELETION or INSERTION
+                    if ( nextOp.Type == 'D' || nextOp.Type == 'I' ) {
+
+                        // if there is a CIGAR op after the DEL/INS
+                        if ( i < numCigarOps - 2 ) {
+                            const CigarOp& nextNextOp = al.CigarData.at(i+2);
                             
-                        // if next CIGAR op is either DELETION or INSERTION
-                        if ( nextOp.Type == 'D' || nextOp.Type == 'I' ) {
-
-                            // if there is a CIGAR op after the DEL/INS
-                            if ( i < numCigarOps - 2 ) {
-                                const CigarOp& nextNextOp = al.CigarData.at(i+2);
-                                
-                                // if next CIGAR op is clipping or ref_skip
-                                if ( nextNextOp.Type == 'S' || 
-                                     nextNextOp.Type == 'N' ||
-                                     nextNextOp.Type == 'H' )
-                                    pileupAlignment.IsSegmentEnd = true;
-                            } 
-                            else {
-                                pileupAlignment.IsSegmentEnd = true;
-                                
-                                // if next CIGAR op is clipping or ref_skip
-                                if ( nextOp.Type == 'S' || 
-                                     nextOp.Type == 'N' ||
-                                     nextOp.Type == 'H' )
-                                    pileupAlignment.IsSegmentEnd = true;
+                            // if next CIGAR op is clipping or ref_skip
+                            if ( nextNextOp.Type == 'S' || 
+                                 nextNextOp.Type == 'N' ||
+                                 nextNextOp.Type == 'H' )
+                                pileupRead.IsSegmentEnd = true;
+
+                            // soft clip after the insertion
+                            if ( nextNextOp.Type == 'S' && nextOp.Type == 'I' ) {
+                                SetSequence(activeAlignment, pileupRead.PositionInAlignment + 1 + nextOp.Length,
+                                            nextNextOp.Length, pileupRead.TrailingSoftClip);
                             }
-                        }
-                        
-                        // otherwise
-                        else { 
-                        
+                        } 
+                        else {
+                            pileupRead.IsSegmentEnd = true;
+                            
                             // if next CIGAR op is clipping or ref_skip
                             if ( nextOp.Type == 'S' || 
                                  nextOp.Type == 'N' ||
                                  nextOp.Type == 'H' )
-                                pileupAlignment.IsSegmentEnd = true;
+                                pileupRead.IsSegmentEnd = true;
                         }
                     }
                     
-                    // else this is last operation
-                    else pileupAlignment.IsSegmentEnd = true;
+                    // otherwise
+                    else { 
+                    
+                        // if next CIGAR op is clipping or ref_skip
+                        if ( nextOp.Type == 'S' || 
+                             nextOp.Type == 'N' ||
+                             nextOp.Type == 'H' )
+                            pileupRead.IsSegmentEnd = true;
+
+                        // soft clip right after the segment
+                        if ( nextOp.Type == 'S' )
+                            SetSequence(activeAlignment, pileupRead.PositionInAlignment + 1, nextOp.Length, pileupRead.TrailingSoftClip);
+                    }
                 }
+                
+                // else this is last operation
+                else pileupRead.IsSegmentEnd = true;
             }
-          
-            // increment markers
-            genomePosition      += op.Length;
-            positionInAlignment += op.Length;
         } 
         
         // if op is DELETION
         else if ( op.Type == 'D' ) {
           
-            // if deletion op overlaps current position
-            if ( genomePosition + (int)op.Length > CurrentPosition ) {
-              
-                // set pileup data
-                pileupAlignment.IsCurrentDeletion   = true;
-                pileupAlignment.IsNextDeletion      = false;
-                pileupAlignment.IsNextInsertion     = true;
-                pileupAlignment.PositionInAlignment = positionInAlignment + (CurrentPosition - genomePosition);
-            }
-            
-            // increment marker
-            genomePosition += op.Length;
+            // set pileup data
+            pileupRead.IsCurrentDeletion   = true;
+            pileupRead.IsNextDeletion      = false;
+            pileupRead.IsNextInsertion     = true;
+            pileupRead.PositionInAlignment = positionInAlignment + (CurrentPosition - genomePosition);
         }
 
-        // if op is REF_SKIP
-        else if ( op.Type == 'N' ) {
-            genomePosition += op.Length;
-        }
-        
-        // if op is INSERTION or SOFT_CLIP
-        else if ( op.Type == 'I' || op.Type == 'S' ) {
-            positionInAlignment += op.Length;
+        // ignore alignment if REF_SKIP
+        else if ( op.Type == 'N' )
+            saveAlignment = false;
+    }
+
+    // read base at current position, deletions have none
+    if ( saveAlignment && !pileupRead.IsCurrentDeletion )
+        ReadBase(activeAlignment, pileupRead);
+
+    // drop bases failing the base filters, deletions have no quality of their own
+    if ( saveAlignment ) {
+        if ( IsOverlapClipped(al) ||
+             (!pileupRead.IsCurrentDeletion && IsLowQualityBase(pileupRead)) )
+        {
+            saveAlignment = false;
         }
-        
-        // checl for beginning of new read segment
-        if ( op.Type == 'N' ||
-             op.Type == 'S' ||
-             op.Type == 'H' )
-            isNewReadSegment = true;
-        else 
-            isNewReadSegment = false;
-      
-        // if we've moved beyond current position
-        if ( genomePosition > CurrentPosition ) {
-            if ( op.Type == 'N' ) saveAlignment = false; // ignore alignment if REF_SKIP
+    }
+
+    // save pileup position if flag is true
+    if ( saveAlignment ) {
+        activeAlignment.ReadIndex = (int)CurrentPileupData.PileupReads.size();
+        CurrentPileupData.PileupReads.push_back( pileupRead );
+    }
+}
+
+void PileupEngine::PileupEnginePrivate::ReadBase(const ActiveAlignment& activeAlignment, PileupRead& pileupRead) const {
+
+    const BamAlignment& al = activeAlignment.Alignment;
+    const int i = pileupRead.PositionInAlignment;
+    if ( i < 0 || i >= al.Length )
+        return;
+
+    // take base nibble & quality byte straight from the BAM-encoded data
+    if ( activeAlignment.EncodedBases != 0 ) {
+        pileupRead.BaseCode    = ( activeAlignment.EncodedBases[i/2] >> (4*(1-(i%2))) ) & 0xf;
+        pileupRead.BaseQuality = activeAlignment.EncodedQualities[i];
+        return;
+    }
+
+    // otherwise fall back on the string fields
+    // N.B. - Qualities are stored as FASTQ characters, offset by 33
+    if ( i < (int)al.QueryBases.size() ) {
+        const char* code = strchr(Constants::BAM_DNA_LOOKUP, toupper(al.QueryBases[i]));
+        if ( code != 0 && *code != '\0' )
+            pileupRead.BaseCode = (uint8_t)(code - Constants::BAM_DNA_LOOKUP);
+    }
+    if ( i < (int)al.Qualities.size() && al.Qualities[i] != (char)0xFF )
+        pileupRead.BaseQuality = (uint8_t)(al.Qualities[i] - 33);
+}
+
+void PileupEngine::PileupEnginePrivate::SetSequence(const ActiveAlignment& activeAlignment,
+                                                     const int32_t offset,
+                                                     const int length,
+                                                     PileupSequence& sequence) const
+{
+    // view straight into the BAM-encoded sequence, if possible
+    const BamAlignment& al = activeAlignment.Alignment;
+    sequence.EncodedBases = activeAlignment.EncodedBases;
+    sequence.Bases  = ( (activeAlignment.EncodedBases == 0 && !al.QueryBases.empty()) ? al.QueryBases.c_str() : 0 );
+    sequence.Offset = offset;
+    sequence.Length = length;
+}
+
+void PileupEngine::PileupEnginePrivate::SiftExpiringAlignment(size_t index) {
+
+    // restore the heap order around an entry whose end position changed, moving it up towards the root
+    // while it ends before its parent, or else down while a child ends before it
+    while ( index > 0 && ExpiringAlignments[(index - 1) / 2] < ExpiringAlignments[index] ) {
+        swap(ExpiringAlignments[(index - 1) / 2], ExpiringAlignments[index]);
+        index = (index - 1) / 2;
+    }
+
+    const size_t heapSize = ExpiringAlignments.size();
+    while ( true ) {
+        size_t firstIndex = index;
+        const size_t childIndex = 2 * index + 1;
+        if ( childIndex < heapSize && ExpiringAlignments[firstIndex] < ExpiringAlignments[childIndex] )
+            firstIndex = childIndex;
+        if ( childIndex + 1 < heapSize && ExpiringAlignments[firstIndex] < ExpiringAlignments[childIndex + 1] )
+            firstIndex = childIndex + 1;
+        if ( firstIndex == index )
+            break;
+        swap(ExpiringAlignments[firstIndex], ExpiringAlignments[index]);
+        index = firstIndex;
+    }
+}
+
+void PileupEngine::PileupEnginePrivate::SkipToRegion(const int position) {
+
+    // jump over positions before the region start (up to 'position') without building pileup data
+    if ( CurrentId == Region.LeftRefID && IsBeforeRegion(CurrentId, CurrentPosition) )
+        CurrentPosition = min(position, Region.LeftPosition);
+}
+
+void PileupEngine::PileupEnginePrivate::VisitUpTo(const int position) {
+
+    // print pileup data of the positions before 'position' on the current reference
+    SkipToRegion(position);
+    SkipToSite(position);
+    while ( position > CurrentPosition ) {
+
+        // jump straight to 'position' if nothing covers the positions in between
+        if ( IsSkippingGaps && IsWindowEmpty() ) {
+            ApplyGapVisitors(position - CurrentPosition);
+            CurrentPosition = position;
             break;
         }
+
+        ApplyVisitors();
+        ++CurrentPosition;
+        SkipToSite(position);
     }
+}
 
-    // save pileup position if flag is true
-    if ( saveAlignment )
-        CurrentPileupData.PileupAlignments.push_back( pileupAlignment );
+bool PileupEngine::PileupEnginePrivate::SkipToSite(const int position) {
+
+    if ( !HasSites )
+        return true;
+
+    // jump over positions between sites (up to 'position') without building pileup data
+    while ( NextSite < Sites.size() && Sites[NextSite] < CurrentPosition )
+        ++NextSite;
+    if ( NextSite == Sites.size() ) {
+        CurrentPosition = max(CurrentPosition, position);
+        return false;
+    }
+    CurrentPosition = max(CurrentPosition, min(position, Sites[NextSite]));
+    return true;
 }
 
 // ---------------------------------------------
 // PileupEngine implementation
 
+const int PileupEngine::DefaultLookbackLength;
+
 PileupEngine::PileupEngine(void)
     : d( new PileupEnginePrivate )
 { }
@@ -342,5 +1050,48 @@ PileupEngine::~PileupEngine(void) {
 }
 
 bool PileupEngine::AddAlignment(const BamAlignment& al) { return d->AddAlignment(al); }
+void PileupEngine::AddBatchVisitor(BatchPileupVisitor* visitor) { d->BatchVisitors.push_back(visitor); }
 void PileupEngine::AddVisitor(PileupVisitor* visitor) { d->Visitors.push_back(visitor); }
+void PileupEngine::AdvanceTo(const int refId, const int position) { d->AdvanceTo(refId, position); }
 void PileupEngine::Flush(void) { d->Flush(); }
+
+BamRegion PileupEngine::GetReadRegion(const BamRegion& region, const int lookbackLength) {
+
+    // N.B. - regions without a left bound are read from their start anyway
+    BamRegion readRegion = region;
+    if ( region.isLeftBoundSpecified() )
+        readRegion.LeftPosition = max(region.LeftPosition - max(lookbackLength, 0), 0);
+    return readRegion;
+}
+
+void PileupEngine::SetAggregateInsertions(bool aggregateInsertions) {
+    d->IsAggregatingInsertions = aggregateInsertions;
+}
+
+void PileupEngine::SetBatchSize(int batchSize) {
+    d->BatchSize = max(batchSize, 1);
+}
+
+void PileupEngine::SetCopyAlignments(bool copyAlignments) {
+    d->IsCopyingAlignments = copyAlignments;
+}
+
+void PileupEngine::SetFilter(const PileupFilter& filter) {
+    d->Filter = filter;
+    d->RandomState = filter.DownsamplingSeed;
+}
+
+void PileupEngine::SetRegion(const BamRegion& region) {
+    d->Region = region;
+    d->HasRegion = true;
+}
+
+void PileupEngine::SetSites(const vector<int>& positions) {
+    d->Sites = positions;
+    d->HasSites = true;
+    d->NextSite = 0;
+}
+
+void PileupEngine::SetSkipGaps(bool skipGaps) {
+    d->IsSkippingGaps = skipGaps;
+}
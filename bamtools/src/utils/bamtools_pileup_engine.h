@@ -13,12 +13,81 @@
 #include "utils/utils_global.h"
 
 #include <api/BamAlignment.h>
+#include <string>
 #include <vector>
 
 namespace BamTools {
 
+// view of consecutive bases of a read, decoded on access
+// N.B. - refers to the alignment held by the engine, only valid during PileupVisitor::Visit()
+struct UTILS_EXPORT PileupSequence {
+
+    // data members
+    const uint8_t* EncodedBases;  // BAM-encoded sequence of the read, null if the view is on Bases
+    const char* Bases;            // QueryBases of the read, used if not read from a BAM file
+    int32_t Offset;               // position in alignment of the first base
+    int Length;
+
+    // ctor
+    PileupSequence(void)
+        : EncodedBases(0)
+        , Bases(0)
+        , Offset(0)
+        , Length(0)
+    { }
+
+    // methods
+    char operator[](const int i) const;   // i-th base, upper case; 'N' if the read has no sequence
+    bool operator==(const PileupSequence& other) const;
+    std::string ToString(void) const;
+};
+
+// contains auxiliary data about a single BamAlignment
+// at current position considered
+// N.B. - refers to the alignment held by the engine, only valid during PileupVisitor::Visit()
+//        base & quality are read from the BAM-encoded data, so alignments need not have their
+//        string fields built (see BamReader::GetNextAlignmentCore())
+struct UTILS_EXPORT PileupRead {
+  
+    // data members
+    const BamAlignment* Alignment;
+    int32_t PositionInAlignment;
+    bool IsCurrentDeletion;
+    bool IsNextDeletion;
+    bool IsNextInsertion;
+    int DeletionLength;
+    int InsertionLength;
+    bool IsSegmentBegin;
+    bool IsSegmentEnd;
+    uint8_t BaseCode;       // 4-bit BAM code of the base, index into "=ACMGRSVTWYHKDBN"; 15 (N) if none
+    uint8_t BaseQuality;    // phred quality of the base, 0xFF if not stored
+    bool IsMateOverlap;     // the mate also covers this position, this read stands for both (see PileupFilter)
+    bool IsMateConflict;    // ... and the mates disagree, this read is the one with the higher quality base
+    PileupSequence InsertedBases;    // bases of the next insertion, if IsNextInsertion
+    PileupSequence LeadingSoftClip;  // soft clip just before the segment, if IsSegmentBegin
+    PileupSequence TrailingSoftClip; // soft clip just after the segment & any insertion ending it, if IsSegmentEnd
+    
+    // ctor
+    PileupRead(const BamAlignment* al = 0)
+        : Alignment(al)
+        , PositionInAlignment(-1)
+        , IsCurrentDeletion(false)
+        , IsNextDeletion(false)
+        , IsNextInsertion(false)
+        , DeletionLength(0)
+        , InsertionLength(0)
+        , IsSegmentBegin(false)
+        , IsSegmentEnd(false)
+        , BaseCode(15)
+        , BaseQuality(0xFF)
+        , IsMateOverlap(false)
+        , IsMateConflict(false)
+    { }
+};
+
 // contains auxiliary data about a single BamAlignment
 // at current position considered
+// N.B. - holds a copy of the alignment, only filled in if the engine is set to copy alignments
 struct UTILS_EXPORT PileupAlignment {
   
     // data members
@@ -31,8 +100,12 @@ struct UTILS_EXPORT PileupAlignment {
     int InsertionLength;
     bool IsSegmentBegin;
     bool IsSegmentEnd;
+    uint8_t BaseCode;
+    uint8_t BaseQuality;
+    bool IsMateOverlap;
+    bool IsMateConflict;
     
-    // ctor
+    // ctors
     PileupAlignment(const BamAlignment& al)
         : Alignment(al)
         , PositionInAlignment(-1)
@@ -43,16 +116,53 @@ struct UTILS_EXPORT PileupAlignment {
         , InsertionLength(0)
         , IsSegmentBegin(false)
         , IsSegmentEnd(false)
+        , BaseCode(15)
+        , BaseQuality(0xFF)
+        , IsMateOverlap(false)
+        , IsMateConflict(false)
+    { }
+
+    PileupAlignment(const PileupRead& read)
+        : Alignment(*read.Alignment)
+        , PositionInAlignment(read.PositionInAlignment)
+        , IsCurrentDeletion(read.IsCurrentDeletion)
+        , IsNextDeletion(read.IsNextDeletion)
+        , IsNextInsertion(read.IsNextInsertion)
+        , DeletionLength(read.DeletionLength)
+        , InsertionLength(read.InsertionLength)
+        , IsSegmentBegin(read.IsSegmentBegin)
+        , IsSegmentEnd(read.IsSegmentEnd)
+        , BaseCode(read.BaseCode)
+        , BaseQuality(read.BaseQuality)
+        , IsMateOverlap(read.IsMateOverlap)
+        , IsMateConflict(read.IsMateConflict)
     { }
 };
   
+// distinct inserted sequence after a position, with the number of reads carrying it
+struct UTILS_EXPORT PileupInsertion {
+
+    // data members
+    PileupSequence Bases;   // as inserted by the first of these reads
+    int Count;
+
+    // ctor
+    PileupInsertion(const PileupSequence& bases = PileupSequence())
+        : Bases(bases)
+        , Count(0)
+    { }
+};
+
 // contains all data at a position
 struct UTILS_EXPORT PileupPosition {
   
     // data members
     int RefId;
     int Position;
+    int TotalDepth;     // alignments overlapping the position, including those left out by the depth cap
+    std::vector<PileupRead> PileupReads;
     std::vector<PileupAlignment> PileupAlignments;
+    std::vector<PileupInsertion> Insertions;    // in order of first read, only if the engine aggregates insertions
 
     // ctor
     PileupPosition(const int& refId = 0,
@@ -60,10 +170,37 @@ struct UTILS_EXPORT PileupPosition {
                    const std::vector<PileupAlignment>& alignments = std::vector<PileupAlignment>())
         : RefId(refId)
         , Position(position)
+        , TotalDepth(0)
         , PileupAlignments(alignments)
     { }
 };
   
+// read & base filters applied before alignments enter the pileup
+struct UTILS_EXPORT PileupFilter {
+
+    // data members
+    uint16_t MinMapQuality;  // alignments with lower mapping quality are never stored
+    int MinBaseQuality;      // bases with lower (phred) quality are left out of PileupReads
+    uint32_t RequiredFlags;  // alignments must have all of these flag bits set
+    uint32_t FilteredFlags;  // alignments must have none of these flag bits set
+    bool ClipOverlaps;       // leave out bases of the leftmost mate where its mate overlaps it
+    bool MergeOverlappingMates; // where both mates of a pair cover a position, report one read for the fragment
+    int MaxDepth;            // if positive, alignments past this depth are reservoir sampled as they are added
+    uint32_t DownsamplingSeed; // seed of the reservoir sampling, the same input always gives the same sample
+
+    // ctor
+    PileupFilter(void)
+        : MinMapQuality(0)
+        , MinBaseQuality(0)
+        , RequiredFlags(0)
+        , FilteredFlags(0)
+        , ClipOverlaps(false)
+        , MergeOverlappingMates(false)
+        , MaxDepth(0)
+        , DownsamplingSeed(0)
+    { }
+};
+
 class UTILS_EXPORT PileupVisitor {
   
     public:
@@ -72,6 +209,85 @@ class UTILS_EXPORT PileupVisitor {
   
     public:
         virtual void Visit(const PileupPosition& pileupData) =0;
+
+        // called instead of Visit() for a run of positions without any alignment,
+        // only if the engine is set to skip gaps
+        virtual void VisitGap(const int refId, const int position, const int length) { }
+};
+
+// completed positions in struct-of-arrays layout, the reads of the i-th position
+// are found at indices [ReadOffsets[i], ReadOffsets[i+1]) of the per-read arrays
+// N.B. - holds no references to alignments, so remains valid after the positions are visited
+struct UTILS_EXPORT PileupPositionBatch {
+
+    // per-read flags
+    enum ReadFlag { ReverseStrand   = 0x01
+                  , CurrentDeletion = 0x02
+                  , NextDeletion    = 0x04
+                  , NextInsertion   = 0x08
+                  , SegmentBegin    = 0x10
+                  , SegmentEnd      = 0x20
+                  , MateOverlap     = 0x40
+                  , MateConflict    = 0x80
+                  };
+
+    // per-position data members
+    std::vector<int> RefIds;
+    std::vector<int> Positions;
+    std::vector<int> TotalDepths;
+    std::vector<int> ReadOffsets;
+
+    // per-read data members
+    std::vector<char> Bases;                  // '*' at deletions
+    std::vector<uint8_t> Qualities;           // phred scaled, 0xFF at deletions or if not stored
+    std::vector<uint8_t> MapQualities;
+    std::vector<uint8_t> Flags;               // ReadFlag bits
+    std::vector<int32_t> PositionsInAlignment;
+    std::vector<int> DeletionLengths;
+    std::vector<int> InsertionLengths;
+
+    // ctor
+    PileupPositionBatch(void)
+        : ReadOffsets(1, 0)
+    { }
+
+    // methods
+    void Append(const PileupPosition& pileupData);
+    void Clear(void);
+    size_t Size(void) const { return Positions.size(); }
+};
+
+// receives completed positions a batch at a time
+class UTILS_EXPORT BatchPileupVisitor {
+
+    public:
+        BatchPileupVisitor(void) { }
+        virtual ~BatchPileupVisitor(void) { }
+
+    public:
+        virtual void VisitBatch(const PileupPositionBatch& batch) =0;
+};
+
+// feeds a BatchPileupVisitor from anywhere a PileupVisitor is expected
+// N.B. - Flush() must be called after the last position to deliver the final batch
+class UTILS_EXPORT BatchPileupVisitorAdapter : public PileupVisitor {
+
+    public:
+        BatchPileupVisitorAdapter(BatchPileupVisitor* visitor, const int batchSize = 4096)
+            : PileupVisitor()
+            , m_visitor(visitor)
+            , m_batchSize(batchSize)
+        { }
+        ~BatchPileupVisitorAdapter(void) { }
+
+    public:
+        void Flush(void);
+        void Visit(const PileupPosition& pileupData);
+
+    private:
+        BatchPileupVisitor* m_visitor;
+        int m_batchSize;
+        PileupPositionBatch m_batch;
 };
 
 class UTILS_EXPORT PileupEngine {
@@ -82,8 +298,30 @@ class UTILS_EXPORT PileupEngine {
         
     public:
         bool AddAlignment(const BamAlignment& al);
+        void AddBatchVisitor(BatchPileupVisitor* visitor);
         void AddVisitor(PileupVisitor* visitor);
+        // visits every position before the given one, as adding an alignment starting there would,
+        // so engines fed parts of the same sorted input can be kept in step
+        void AdvanceTo(const int refId, const int position);
         void Flush(void);
+        void SetAggregateInsertions(bool aggregateInsertions);
+        void SetBatchSize(int batchSize);
+        void SetCopyAlignments(bool copyAlignments);
+        void SetFilter(const PileupFilter& filter);
+        void SetRegion(const BamRegion& region);
+        void SetSites(const std::vector<int>& positions);
+        void SetSkipGaps(bool skipGaps);
+
+    public:
+        // alignments for a region are read from this far before its start, as seeking a BAI
+        // index straight to the start may miss reads that begin in the preceding 16kb window
+        // N.B. - reads starting further back than this (very long or spliced ones) can still be missed
+        static const int DefaultLookbackLength = 1 << 14;
+
+        // region to read alignments from for a pileup of 'region', which the engine itself
+        // should still be given: it ignores the reads ending before the region starts
+        static BamRegion GetReadRegion(const BamRegion& region,
+                                       const int lookbackLength = DefaultLookbackLength);
         
     private:
         struct PileupEnginePrivate;
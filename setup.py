@@ -61,7 +61,10 @@ bamtools_source = [
  'bamtools/src/api/internal/sam/SamHeaderValidator_p.cpp',
  'bamtools/src/api/internal/utils/BamException_p.cpp',
  'bamtools/src/utils/bamtools_pileup_engine.cpp',
+ 'bamtools/src/utils/bamtools_depth_engine.cpp',
+ 'bamtools/src/utils/bamtools_parallel_pileup_engine.cpp',
  'bamtools/src/utils/bamtools_fasta.cpp',
+ 'bamtools/src/utils/bamtools_packed_reference.cpp',
  'bamtools/src/utils/bamtools_utilities.cpp',
  ]
 
@@ -80,7 +83,7 @@ ext_modules = [Extension('newpybam',
                      language='c++',
                      include_dirs=['./', './src', boost_source, './bamtools/src/'],
                      extra_compile_args=extra_compile_args,
-                     libraries=['z'],
+                     libraries=['z', 'pthread'],
                      extra_link_args=extra_link_args
                      )]
 
@@ -1,7 +1,17 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
-#include <queue>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <boost/foreach.hpp>
 #include <boost/graph/adjacency_list.hpp>
@@ -17,10 +27,20 @@
 #include <boost/python/def.hpp>
 #include <boost/python/list.hpp>
 #include <boost/python/tuple.hpp>
+#include <boost/python/extract.hpp>
+#include <boost/python/stl_iterator.hpp>
+#include <boost/python/return_internal_reference.hpp>
+#include <boost/python/scope.hpp>
+#include <boost/shared_ptr.hpp>
 
+#include "bamtools/src/api/BamConstants.h"
+#include "bamtools/src/api/BamMultiReader.h"
 #include "bamtools/src/api/BamReader.h"
 #include "bamtools/src/utils/bamtools_pileup_engine.h"
+#include "bamtools/src/utils/bamtools_depth_engine.h"
+#include "bamtools/src/utils/bamtools_parallel_pileup_engine.h"
 #include "bamtools/src/utils/bamtools_fasta.h"
+#include "bamtools/src/utils/bamtools_packed_reference.h"
 #include "bamtools/src/utils/bamtools_utilities.h"
 
 using namespace std;
@@ -28,304 +48,2435 @@ using namespace boost;
 using namespace BamTools;
 
 
-python::tuple CreatePileupTuple(const PileupPosition& pileupData)
+struct PileupSummary
+{
+	int RefId;
+	int Position;
+	int NtData[5][6];
+	int MajorBaseIdx;
+	int MinorBaseIdx;
+	int Ambiguous;
+	int InsertionCount;
+	int DeletionCount;
+	double Entropy;
+};
+
+
+void ClearPileupSummary(PileupSummary& summary)
+{
+	memset(summary.NtData, 0, sizeof(summary.NtData));
+	summary.MajorBaseIdx = 0;
+	summary.MinorBaseIdx = 1;
+	summary.Ambiguous = 0;
+	summary.InsertionCount = 0;
+	summary.DeletionCount = 0;
+	summary.Entropy = 0.0;
+}
+
+
+// Statistics computed by a pileup summarizer, statistics not selected are left zero
+enum PileupStatistic
+{
+	PileupCounts = 1 << 0,
+	PileupQualities = 1 << 1,
+	PileupMapQualities = 1 << 2,
+	PileupDistances = 1 << 3,
+	PileupEntropy = 1 << 4,
+	PileupIndels = 1 << 5,
+	
+	// Preset of the pileup tuple layout
+	PileupTupleStatistics = (1 << 6) - 1
+};
+
+
+// Index of each 4-bit BAM base code in the pileup summary, 4 for N, -1 for other codes
+static const int PileupBaseIndices[16] = {-1, 0, 1, -1, 2, -1, -1, -1, 3, -1, -1, -1, -1, -1, -1, 4};
+
+
+// Summarizes pileups computing only the statistics selected at compile time
+template<int TStatistics>
+struct PileupSummarizer
+{
+	// Entropy, major and minor bases are calculated from the counts
+	static const bool HasCounts = (TStatistics & (PileupCounts | PileupEntropy)) != 0;
+	static const bool HasQualities = (TStatistics & PileupQualities) != 0;
+	static const bool HasMapQualities = (TStatistics & PileupMapQualities) != 0;
+	static const bool HasDistances = (TStatistics & PileupDistances) != 0;
+	static const bool HasEntropy = (TStatistics & PileupEntropy) != 0;
+	static const bool HasIndels = (TStatistics & PileupIndels) != 0;
+	static const bool HasBases = HasCounts || HasQualities || HasMapQualities || HasDistances;
+	
+	// Accumulate the counts of a single read into a pileup summary
+	static void Add(const PileupRead& pa, PileupSummary& summary)
+	{
+		int (&ntData)[5][6] = summary.NtData;
+		const BamAlignment& ba = *pa.Alignment;
+		
+		// adjacent insertions and deletions
+		if (HasIndels)
+		{
+			for (std::vector<CigarOp>::const_iterator opIter = ba.CigarData.begin(); opIter != ba.CigarData.end(); opIter++)
+			{
+				if (opIter->Type == 'I')
+				{
+					summary.InsertionCount++;
+				}
+				else if (opIter->Type == 'D')
+				{
+					summary.DeletionCount++;
+				}
+			}
+		}
+		
+		if (!HasBases || pa.IsCurrentDeletion)
+		{
+			return;
+		}
+		
+		// Base and quality come from the packed BAM data, string fields need not be built
+		int baseIdx = PileupBaseIndices[pa.BaseCode];
+		
+		if (baseIdx == 4)
+		{
+			if (HasCounts)
+			{
+				summary.Ambiguous++;
+			}
+			return;
+		}
+		
+		if (baseIdx < 0)
+		{
+			throw runtime_error("unrecognized base " + string(1, Constants::BAM_DNA_LOOKUP[pa.BaseCode]));
+		}
+		
+		// count
+		if (HasCounts)
+		{
+			ntData[baseIdx][0]++;
+			ntData[4][0]++;
+		}
+		
+		// quality, summed as FASTQ characters
+		if (HasQualities)
+		{
+			int quality = (pa.BaseQuality == 0xFF) ? (int)(char)0xFF : pa.BaseQuality + 33;
+			ntData[baseIdx][1] += quality;
+			ntData[4][1] += quality;
+		}
+		
+		// mapping quality
+		if (HasMapQualities)
+		{
+			ntData[baseIdx][2] += ba.MapQuality;
+			ntData[4][2] += ba.MapQuality;
+		}
+		
+		if (HasDistances)
+		{
+			// distance
+			ntData[baseIdx][3] += (ba.IsReverseStrand()) ? ba.Length - pa.PositionInAlignment - 1 : pa.PositionInAlignment;
+			ntData[4][3] += (ba.IsReverseStrand()) ? ba.Length - pa.PositionInAlignment - 1 : pa.PositionInAlignment;
+			
+			// direction
+			ntData[baseIdx][3] += (ba.IsReverseStrand()) ? 1 : 0;
+			ntData[4][3] += (ba.IsReverseStrand()) ? 1 : 0;
+		}
+	}
+	
+	// Calculate major and minor bases and entropy once all reads have been added
+	static void Finish(int refId, int position, int numAlignments, PileupSummary& summary)
+	{
+		summary.RefId = refId;
+		summary.Position = position;
+		
+		if (!HasCounts)
+		{
+			return;
+		}
+		
+		const int (&ntData)[5][6] = summary.NtData;
+		
+		// Identify major base
+		int majorBaseIdx = 0;
+		for (int baseIdx = 0; baseIdx < 4; baseIdx++)
+		{
+			if (ntData[baseIdx][0] > ntData[majorBaseIdx][0])
+			{
+				majorBaseIdx = baseIdx;
+			}
+		}
+		
+		// Identify minor base, initialize to base that is not the major base
+		int minorBaseIdx = (majorBaseIdx + 1) % 4;
+		for (int baseIdx = 0; baseIdx < 4; baseIdx++)
+		{
+			if (ntData[baseIdx][0] > ntData[minorBaseIdx][0] && baseIdx != majorBaseIdx)
+			{
+				minorBaseIdx = baseIdx;
+			}
+		}
+		
+		summary.MajorBaseIdx = majorBaseIdx;
+		summary.MinorBaseIdx = minorBaseIdx;
+		
+		if (!HasEntropy)
+		{
+			return;
+		}
+		
+		// Calculate entropy
+		double depth = (double)numAlignments; // NOTE: COPIED FROM JEFF, THIS MAY BE A WRONG
+		double entropy = 0.0;
+		for (int baseIdx = 0; baseIdx < 4; baseIdx++)
+		{
+			double probability = (double)ntData[baseIdx][0] / depth;
+			if (probability != 0)
+			{
+				entropy -= (log(probability) * probability);
+			}
+		}
+		
+		summary.Entropy = entropy;
+	}
+	
+	static void Calculate(const PileupPosition& pileupData, PileupSummary& summary)
+	{
+		ClearPileupSummary(summary);
+		
+		for (vector<PileupRead>::const_iterator pileupIter = pileupData.PileupReads.begin(); pileupIter != pileupData.PileupReads.end(); ++pileupIter)
+		{
+			Add(*pileupIter, summary);
+		}
+		
+		Finish(pileupData.RefId, pileupData.Position, (int)pileupData.PileupReads.size(), summary);
+	}
+};
+
+
+typedef void (*PileupSummaryFunction)(const PileupPosition& pileupData, PileupSummary& summary);
+
+// Table of summarizers instantiated for every combination of statistics
+template<int TStatistics>
+struct PileupSummarizerTable
+{
+	static void Fill(PileupSummaryFunction* functions)
+	{
+		functions[TStatistics] = &PileupSummarizer<TStatistics>::Calculate;
+		PileupSummarizerTable<TStatistics - 1>::Fill(functions);
+	}
+};
+
+template<>
+struct PileupSummarizerTable<-1>
+{
+	static void Fill(PileupSummaryFunction* functions)
+	{
+	}
+};
+
+PileupSummaryFunction GetPileupSummaryFunction(int statistics)
+{
+	static PileupSummaryFunction functions[PileupTupleStatistics + 1] = {0};
+	
+	if (functions[0] == 0)
+	{
+		PileupSummarizerTable<PileupTupleStatistics>::Fill(functions);
+	}
+	
+	if (statistics < 0 || statistics > PileupTupleStatistics)
+	{
+		throw runtime_error("invalid pileup statistics " + lexical_cast<string>(statistics));
+	}
+	
+	return functions[statistics];
+}
+
+
+// Summaries of the pileup tuple preset
+void AddPileupAlignment(const PileupRead& pa, PileupSummary& summary)
+{
+	PileupSummarizer<PileupTupleStatistics>::Add(pa, summary);
+}
+
+void FinishPileupSummary(int refId, int position, int numAlignments, PileupSummary& summary)
+{
+	PileupSummarizer<PileupTupleStatistics>::Finish(refId, position, numAlignments, summary);
+}
+
+void CalculatePileupSummary(const PileupPosition& pileupData, PileupSummary& summary)
+{
+	PileupSummarizer<PileupTupleStatistics>::Calculate(pileupData, summary);
+}
+
+
+python::tuple CreatePileupTuple(const PileupSummary& summary)
+{
+	const int (&ntData)[5][6] = summary.NtData;
+	
+	// Interface is 1-based, bamtools is 0-based
+	int position = summary.Position + 1;
+	
+	return python::make_tuple(position,
+							  python::make_tuple(ntData[0][0], ntData[0][1], ntData[0][2], ntData[0][3], ntData[0][4], ntData[0][5]),
+							  python::make_tuple(ntData[1][0], ntData[1][1], ntData[1][2], ntData[1][3], ntData[1][4], ntData[1][5]),
+							  python::make_tuple(ntData[2][0], ntData[2][1], ntData[2][2], ntData[2][3], ntData[2][4], ntData[2][5]),
+							  python::make_tuple(ntData[3][0], ntData[3][1], ntData[3][2], ntData[3][3], ntData[3][4], ntData[3][5]),
+							  python::make_tuple(ntData[4][0], ntData[4][1], ntData[4][2], ntData[4][3], ntData[4][4], ntData[4][5]),
+							  summary.MajorBaseIdx,
+							  summary.MinorBaseIdx,
+							  summary.Ambiguous,
+							  summary.InsertionCount,
+							  summary.Entropy,
+							  summary.DeletionCount,
+							  summary.RefId
+							  );
+}
+
+
+// Contiguous typed array exported to python through the buffer protocol
+class PileupColumn
+{
+public:
+	PileupColumn(const char* format, int itemSize, int width) : m_Format(format), m_ItemSize(itemSize), m_Width(width), m_Size(0)
+	{
+	}
+	
+	void Reserve(int capacity)
+	{
+		// Only called on batches not referenced from python, exported storage is never reallocated
+		m_Data.resize((size_t)capacity * m_Width * m_ItemSize);
+	}
+	
+	int Capacity() const
+	{
+		return (int)(m_Data.size() / (m_Width * m_ItemSize));
+	}
+	
+	template<typename TValue>
+	TValue* Row(int row)
+	{
+		return reinterpret_cast<TValue*>(&m_Data[0]) + (size_t)row * m_Width;
+	}
+	
+	void SetSize(int size)
+	{
+		m_Size = size;
+	}
+	
+	int Size() const
+	{
+		return m_Size;
+	}
+	
+	static int GetBuffer(PyObject* exporter, Py_buffer* view, int flags);
+	
+private:
+	vector<char> m_Data;
+	const char* m_Format;
+	Py_ssize_t m_ItemSize;
+	Py_ssize_t m_Width;
+	int m_Size;
+	Py_ssize_t m_Shape[2];
+	Py_ssize_t m_Strides[2];
+};
+
+int PileupColumn::GetBuffer(PyObject* exporter, Py_buffer* view, int flags)
+{
+	python::extract<PileupColumn&> extractColumn(exporter);
+	if (!extractColumn.check())
+	{
+		PyErr_SetString(PyExc_BufferError, "invalid pileup column");
+		view->obj = 0;
+		return -1;
+	}
+	
+	PileupColumn& column = extractColumn();
+	
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "pileup columns are read only");
+		view->obj = 0;
+		return -1;
+	}
+	
+	column.m_Shape[0] = column.m_Size;
+	column.m_Shape[1] = column.m_Width;
+	column.m_Strides[0] = column.m_Width * column.m_ItemSize;
+	column.m_Strides[1] = column.m_ItemSize;
+	
+	view->obj = exporter;
+	Py_INCREF(exporter);
+	view->buf = column.m_Data.empty() ? 0 : &column.m_Data[0];
+	view->len = column.m_Size * column.m_Width * column.m_ItemSize;
+	view->readonly = 1;
+	view->itemsize = column.m_ItemSize;
+	view->format = ((flags & PyBUF_FORMAT) == PyBUF_FORMAT) ? const_cast<char*>(column.m_Format) : 0;
+	view->ndim = (column.m_Width == 1) ? 1 : 2;
+	view->shape = ((flags & PyBUF_ND) == PyBUF_ND) ? column.m_Shape : 0;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? column.m_Strides : 0;
+	view->suboffsets = 0;
+	view->internal = 0;
+	
+	return 0;
+}
+
+typedef boost::shared_ptr<PileupColumn> PileupColumnPtr;
+
+
+// Struct of arrays holding a batch of pileup summaries
+class PileupBatch
+{
+public:
+	PileupBatch()
+		: Position("i", sizeof(int), 1)
+		, RefId("i", sizeof(int), 1)
+		, NtData("i", sizeof(int), 5 * 6)
+		, MajorBaseIdx("i", sizeof(int), 1)
+		, MinorBaseIdx("i", sizeof(int), 1)
+		, Ambiguous("i", sizeof(int), 1)
+		, InsertionCount("i", sizeof(int), 1)
+		, DeletionCount("i", sizeof(int), 1)
+		, Entropy("d", sizeof(double), 1)
+		, m_Size(0)
+	{
+	}
+	
+	void Reserve(int capacity)
+	{
+		PileupColumn* columns[] = {&Position, &RefId, &NtData, &MajorBaseIdx, &MinorBaseIdx, &Ambiguous, &InsertionCount, &DeletionCount, &Entropy};
+		for (int columnIdx = 0; columnIdx < (int)(sizeof(columns) / sizeof(columns[0])); columnIdx++)
+		{
+			columns[columnIdx]->Reserve(capacity);
+		}
+	}
+	
+	int Capacity() const
+	{
+		return Position.Capacity();
+	}
+	
+	void Clear()
+	{
+		SetSize(0);
+	}
+	
+	void Append(const PileupSummary& summary)
+	{
+		int row = m_Size;
+		
+		// Batches grow while being filled, before any storage is exported to python
+		if (row == Capacity())
+		{
+			Reserve(std::max(2 * row, 1));
+		}
+		
+		// Interface is 1-based, bamtools is 0-based
+		*Position.Row<int>(row) = summary.Position + 1;
+		*RefId.Row<int>(row) = summary.RefId;
+		memcpy(NtData.Row<int>(row), summary.NtData, sizeof(summary.NtData));
+		*MajorBaseIdx.Row<int>(row) = summary.MajorBaseIdx;
+		*MinorBaseIdx.Row<int>(row) = summary.MinorBaseIdx;
+		*Ambiguous.Row<int>(row) = summary.Ambiguous;
+		*InsertionCount.Row<int>(row) = summary.InsertionCount;
+		*DeletionCount.Row<int>(row) = summary.DeletionCount;
+		*Entropy.Row<double>(row) = summary.Entropy;
+		
+		SetSize(row + 1);
+	}
+	
+	int Size() const
+	{
+		return m_Size;
+	}
+	
+	PileupColumn Position;
+	PileupColumn RefId;
+	PileupColumn NtData;
+	PileupColumn MajorBaseIdx;
+	PileupColumn MinorBaseIdx;
+	PileupColumn Ambiguous;
+	PileupColumn InsertionCount;
+	PileupColumn DeletionCount;
+	PileupColumn Entropy;
+	
+private:
+	void SetSize(int size)
+	{
+		PileupColumn* columns[] = {&Position, &RefId, &NtData, &MajorBaseIdx, &MinorBaseIdx, &Ambiguous, &InsertionCount, &DeletionCount, &Entropy};
+		for (int columnIdx = 0; columnIdx < (int)(sizeof(columns) / sizeof(columns[0])); columnIdx++)
+		{
+			columns[columnIdx]->SetSize(size);
+		}
+		m_Size = size;
+	}
+	
+	int m_Size;
+};
+
+typedef boost::shared_ptr<PileupBatch> PileupBatchPtr;
+
+
+struct PileupQueue : PileupVisitor
+{
+	PileupQueue(PileupSummaryFunction summarize) : Summarize(summarize)
+	{
+	}
+	
+	void Visit(const PileupPosition& pileupData)
+	{
+		Pileups.push_back(PileupSummary());
+		Summarize(pileupData, Pileups.back());
+	}
+	
+	void Clear()
+	{
+		Pileups.clear();
+	}
+	
+	PileupSummaryFunction Summarize;
+	std::deque<PileupSummary> Pileups;
+};
+
+// Releases the GIL for the lifetime of the object
+class ScopedGILRelease
+{
+public:
+	ScopedGILRelease() : m_ThreadState(PyEval_SaveThread())
+	{
+	}
+	
+	~ScopedGILRelease()
+	{
+		PyEval_RestoreThread(m_ThreadState);
+	}
+	
+private:
+	PyThreadState* m_ThreadState;
+};
+
+// Acquires the GIL for the lifetime of the object, from a thread that released it
+class ScopedGILAcquire
 {
-	int ntData[5][6] = {{0}};
-	int ambiguous = 0;
-	int insertionCount = 0;
-	int deletionCount = 0;
+public:
+	ScopedGILAcquire() : m_State(PyGILState_Ensure())
+	{
+	}
+	
+	~ScopedGILAcquire()
+	{
+		PyGILState_Release(m_State);
+	}
 	
-	for (vector<PileupAlignment>::const_iterator pileupIter = pileupData.PileupAlignments.begin(); pileupIter != pileupData.PileupAlignments.end(); ++pileupIter)
+private:
+	PyGILState_STATE m_State;
+};
+
+// Holds a pthread mutex for the lifetime of the object
+class ScopedLock
+{
+public:
+	ScopedLock(pthread_mutex_t& mutex) : m_Mutex(mutex)
 	{
-		const PileupAlignment& pa = (*pileupIter);
-		const BamAlignment& ba = pa.Alignment;
+		pthread_mutex_lock(&m_Mutex);
+	}
+	
+	~ScopedLock()
+	{
+		pthread_mutex_unlock(&m_Mutex);
+	}
+	
+private:
+	pthread_mutex_t& m_Mutex;
+};
+
+// Bounded ring buffer of finished pileup summaries between a producer and a consumer thread,
+// each side synchronizes in chunks rather than per summary to avoid waking the other side per position
+class PileupRingBuffer
+{
+public:
+	PileupRingBuffer(int capacity)
+		: m_Summaries(capacity)
+		, m_WakeThreshold(std::max(1, capacity / 2))
+		, m_Head(0)
+		, m_Count(0)
+		, m_Finished(false)
+		, m_Stopped(false)
+		, m_ConsumerWaiting(false)
+		, m_ReadIndex(0)
+		, m_Available(0)
+		, m_Consumed(0)
+	{
+		pthread_mutex_init(&m_Mutex, 0);
+		pthread_cond_init(&m_NotEmpty, 0);
+		pthread_cond_init(&m_NotFull, 0);
+	}
+	
+	~PileupRingBuffer()
+	{
+		pthread_cond_destroy(&m_NotFull);
+		pthread_cond_destroy(&m_NotEmpty);
+		pthread_mutex_destroy(&m_Mutex);
+	}
+	
+	// Producer side, moves summaries from the queue blocking while full, returns false once stopped
+	bool Push(std::deque<PileupSummary>& pileups)
+	{
+		ScopedLock lock(m_Mutex);
+		
+		while (!pileups.empty())
+		{
+			while (m_Count == (int)m_Summaries.size() && !m_Stopped)
+			{
+				pthread_cond_wait(&m_NotFull, &m_Mutex);
+			}
+			
+			if (m_Stopped)
+			{
+				return false;
+			}
+			
+			while (!pileups.empty() && m_Count < (int)m_Summaries.size())
+			{
+				m_Summaries[(m_Head + m_Count) % m_Summaries.size()] = pileups.front();
+				pileups.pop_front();
+				m_Count++;
+			}
+			
+			if (m_ConsumerWaiting && m_Count >= m_WakeThreshold)
+			{
+				pthread_cond_signal(&m_NotEmpty);
+			}
+		}
+		
+		return true;
+	}
+	
+	void Finish(const string& error)
+	{
+		ScopedLock lock(m_Mutex);
+		
+		m_Error = error;
+		m_Finished = true;
+		
+		pthread_cond_signal(&m_NotEmpty);
+	}
+	
+	// Consumer side, blocks while empty and returns 0 once the producer has finished
+	const PileupSummary* Peek()
+	{
+		if (m_Available == 0)
+		{
+			ScopedLock lock(m_Mutex);
+			
+			// Release consumed slots back to the producer
+			m_Head = m_ReadIndex;
+			m_Count -= m_Consumed;
+			m_Consumed = 0;
+			pthread_cond_signal(&m_NotFull);
+			
+			m_ConsumerWaiting = true;
+			while (m_Count == 0 && !m_Finished)
+			{
+				pthread_cond_wait(&m_NotEmpty, &m_Mutex);
+			}
+			m_ConsumerWaiting = false;
+			
+			m_Available = m_Count;
+		}
+		
+		if (m_Available == 0)
+		{
+			return 0;
+		}
+		
+		// Producer never writes to slots between head and head plus count
+		return &m_Summaries[m_ReadIndex];
+	}
+	
+	void Pop()
+	{
+		m_ReadIndex = (m_ReadIndex + 1) % m_Summaries.size();
+		m_Available--;
+		m_Consumed++;
+	}
+	
+	void Stop()
+	{
+		ScopedLock lock(m_Mutex);
+		
+		m_Stopped = true;
+		
+		pthread_cond_signal(&m_NotFull);
+	}
+	
+	// Move unconsumed summaries to the front of a queue, only valid after the producer has exited
+	void Drain(std::deque<PileupSummary>& pileups)
+	{
+		for (int idx = m_Count - m_Consumed - 1; idx >= 0; idx--)
+		{
+			pileups.push_front(m_Summaries[(m_ReadIndex + idx) % m_Summaries.size()]);
+		}
+		
+		m_Head = m_ReadIndex;
+		m_Count = 0;
+		m_Available = 0;
+		m_Consumed = 0;
+	}
+	
+	const string& Error() const
+	{
+		return m_Error;
+	}
+	
+private:
+	vector<PileupSummary> m_Summaries;
+	int m_WakeThreshold;
+	
+	// Shared state, guarded by the mutex
+	int m_Head;
+	int m_Count;
+	bool m_Finished;
+	bool m_Stopped;
+	bool m_ConsumerWaiting;
+	string m_Error;
+	
+	// Consumer state
+	int m_ReadIndex;
+	int m_Available;
+	int m_Consumed;
+	
+	pthread_mutex_t m_Mutex;
+	pthread_cond_t m_NotEmpty;
+	pthread_cond_t m_NotFull;
+};
+
+// Extract integer positions from a contiguous integer array through the buffer protocol,
+// or from any iterable of python integers
+void ExtractPositions(python::object positions, vector<int>& values)
+{
+	values.clear();
+	
+	Py_buffer view;
+	if (PyObject_CheckBuffer(positions.ptr()) && PyObject_GetBuffer(positions.ptr(), &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0)
+	{
+		const char format = (view.format != 0) ? view.format[strlen(view.format) - 1] : 'B';
+		const bool isSigned = (format == 'b' || format == 'h' || format == 'i' || format == 'l' || format == 'q' || format == 'n');
+		const bool isUnsigned = (format == 'B' || format == 'H' || format == 'I' || format == 'L' || format == 'Q' || format == 'N');
+		
+		if (!isSigned && !isUnsigned)
+		{
+			PyBuffer_Release(&view);
+			throw runtime_error("positions must be integers");
+		}
+		
+		const Py_ssize_t numValues = view.len / view.itemsize;
+		values.resize(numValues);
+		for (Py_ssize_t idx = 0; idx < numValues; idx++)
+		{
+			const char* item = static_cast<const char*>(view.buf) + idx * view.itemsize;
+			
+			int64_t value = 0;
+			switch (view.itemsize)
+			{
+				case 1: value = isSigned ? (int64_t)*reinterpret_cast<const int8_t*>(item) : (int64_t)*reinterpret_cast<const uint8_t*>(item); break;
+				case 2: value = isSigned ? (int64_t)*reinterpret_cast<const int16_t*>(item) : (int64_t)*reinterpret_cast<const uint16_t*>(item); break;
+				case 4: value = isSigned ? (int64_t)*reinterpret_cast<const int32_t*>(item) : (int64_t)*reinterpret_cast<const uint32_t*>(item); break;
+				default: value = *reinterpret_cast<const int64_t*>(item); break;
+			}
+			
+			values[idx] = (int)std::max<int64_t>(std::min<int64_t>(value, numeric_limits<int>::max()), numeric_limits<int>::min());
+		}
+		
+		PyBuffer_Release(&view);
+		return;
+	}
+	PyErr_Clear();
+	
+	for (python::stl_input_iterator<python::object> positionIter(positions), positionEnd; positionIter != positionEnd; ++positionIter)
+	{
+		Py_ssize_t value = PyNumber_AsSsize_t((*positionIter).ptr(), PyExc_OverflowError);
+		if (value == -1 && PyErr_Occurred())
+		{
+			python::throw_error_already_set();
+		}
+		values.push_back((int)value);
+	}
+}
+
+// Stable 64 bit FNV-1a hash, used to name cache files across runs
+uint64_t HashString(const string& value, uint64_t hash = 14695981039346656037ULL)
+{
+	for (string::const_iterator charIter = value.begin(); charIter != value.end(); ++charIter)
+	{
+		hash ^= (unsigned char)(*charIter);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Collects the summaries of the positions visited, those covered by an alignment if gaps are skipped
+struct PileupCacheCollector : PileupVisitor
+{
+	PileupCacheCollector(PileupSummaryFunction summarize) : Summarize(summarize)
+	{
+	}
+	
+	void Visit(const PileupPosition& pileupData)
+	{
+		Summaries.push_back(PileupSummary());
+		Summarize(pileupData, Summaries.back());
+	}
+	
+	PileupSummaryFunction Summarize;
+	vector<PileupSummary> Summaries;
+};
+
+// Collects the distinct insertions following each position, positions without any are skipped
+struct InsertionCollector : PileupVisitor
+{
+	void Visit(const PileupPosition& pileupData)
+	{
+		if (pileupData.Insertions.empty())
+		{
+			return;
+		}
+		
+		Insertions.push_back(make_pair(pileupData.Position, vector<pair<string, int> >()));
+		for (vector<PileupInsertion>::const_iterator insIter = pileupData.Insertions.begin(); insIter != pileupData.Insertions.end(); ++insIter)
+		{
+			Insertions.back().second.push_back(make_pair(insIter->Bases.ToString(), insIter->Count));
+		}
+	}
+	
+	vector<pair<int, vector<pair<string, int> > > > Insertions;
+};
+
+// Collects the runs of positions skipped over without any alignment, as (position, length)
+struct GapCollector : PileupVisitor
+{
+	void Visit(const PileupPosition& pileupData)
+	{
+	}
+	
+	void VisitGap(const int refId, const int position, const int length)
+	{
+		Gaps.push_back(make_pair(position, length));
+	}
+	
+	vector<pair<int, int> > Gaps;
+};
+
+// On-disk cache of pileup summaries in fixed tiles of each reference, one memory mappable
+// columnar file per tile, named by a key identifying the bam file and pileup parameters
+class PileupCache
+{
+public:
+	static const int TileShift = 16;
+	
+	void SetDirectory(const string& directory)
+	{
+		m_Directory = directory;
+	}
+	
+	bool IsEnabled() const
+	{
+		return !m_Directory.empty();
+	}
+	
+	// Append cached summaries within [start, end) of a tile, false if the tile is not cached
+	bool Read(uint64_t key, int refId, int tileIdx, int start, int end, vector<PileupSummary>& summaries) const
+	{
+		int fileDescriptor = open(GetFilename(key, refId, tileIdx).c_str(), O_RDONLY);
+		if (fileDescriptor < 0)
+		{
+			return false;
+		}
+		
+		struct stat fileStat;
+		void* data = MAP_FAILED;
+		if (fstat(fileDescriptor, &fileStat) == 0 && fileStat.st_size >= (off_t)sizeof(Header))
+		{
+			data = mmap(0, fileStat.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+		}
+		close(fileDescriptor);
+		
+		if (data == MAP_FAILED)
+		{
+			return false;
+		}
+		
+		// Stale or truncated files are treated as missing and rewritten
+		const Header* header = static_cast<const Header*>(data);
+		const int numRows = header->NumRows;
+		bool isValid = (memcmp(header->Magic, Magic, sizeof(header->Magic)) == 0 &&
+		                header->Key == key && header->RefId == refId && header->TileIdx == tileIdx &&
+		                numRows >= 0 && (size_t)fileStat.st_size == GetFileSize(numRows));
+		
+		if (isValid)
+		{
+			Columns columns(data, numRows);
+			
+			PileupSummary summary;
+			for (int row = std::lower_bound(columns.Position, columns.Position + numRows, start) - columns.Position; row < numRows && columns.Position[row] < end; row++)
+			{
+				summary.RefId = refId;
+				summary.Position = columns.Position[row];
+				memcpy(summary.NtData, columns.NtData + (size_t)row * 30, sizeof(summary.NtData));
+				summary.MajorBaseIdx = columns.MajorBaseIdx[row];
+				summary.MinorBaseIdx = columns.MinorBaseIdx[row];
+				summary.Ambiguous = columns.Ambiguous[row];
+				summary.InsertionCount = columns.InsertionCount[row];
+				summary.DeletionCount = columns.DeletionCount[row];
+				summary.Entropy = columns.Entropy[row];
+				summaries.push_back(summary);
+			}
+		}
+		
+		munmap(data, fileStat.st_size);
+		
+		return isValid;
+	}
+	
+	// Write summaries of a tile, through a temporary file so readers never see partial tiles
+	bool Write(uint64_t key, int refId, int tileIdx, const vector<PileupSummary>& summaries) const
+	{
+		const int numRows = (int)summaries.size();
+		
+		vector<char> data(GetFileSize(numRows));
+		
+		Header* header = reinterpret_cast<Header*>(&data[0]);
+		memcpy(header->Magic, Magic, sizeof(header->Magic));
+		header->Key = key;
+		header->RefId = refId;
+		header->TileIdx = tileIdx;
+		header->NumRows = numRows;
+		header->Reserved = 0;
+		
+		Columns columns(&data[0], numRows);
+		for (int row = 0; row < numRows; row++)
+		{
+			const PileupSummary& summary = summaries[row];
+			columns.Entropy[row] = summary.Entropy;
+			columns.Position[row] = summary.Position;
+			memcpy(columns.NtData + (size_t)row * 30, summary.NtData, sizeof(summary.NtData));
+			columns.MajorBaseIdx[row] = summary.MajorBaseIdx;
+			columns.MinorBaseIdx[row] = summary.MinorBaseIdx;
+			columns.Ambiguous[row] = summary.Ambiguous;
+			columns.InsertionCount[row] = summary.InsertionCount;
+			columns.DeletionCount[row] = summary.DeletionCount;
+		}
+		
+		const string filename = GetFilename(key, refId, tileIdx);
+		const string tempFilename = filename + ".tmp" + lexical_cast<string>(getpid());
+		
+		FILE* file = fopen(tempFilename.c_str(), "wb");
+		if (file == 0)
+		{
+			return false;
+		}
+		
+		bool success = (fwrite(&data[0], 1, data.size(), file) == data.size());
+		success &= (fclose(file) == 0);
+		success = success && (rename(tempFilename.c_str(), filename.c_str()) == 0);
+		
+		if (!success)
+		{
+			remove(tempFilename.c_str());
+		}
+		
+		return success;
+	}
+	
+private:
+	struct Header
+	{
+		char Magic[8];
+		uint64_t Key;
+		int32_t RefId;
+		int32_t TileIdx;
+		int32_t NumRows;
+		int32_t Reserved;
+	};
+	
+	// Column pointers into file data, the double column first to keep it aligned
+	struct Columns
+	{
+		Columns(const void* data, int numRows)
+		{
+			char* columnData = const_cast<char*>(static_cast<const char*>(data)) + sizeof(Header);
+			Entropy = reinterpret_cast<double*>(columnData);
+			Position = reinterpret_cast<int32_t*>(Entropy + numRows);
+			NtData = Position + numRows;
+			MajorBaseIdx = NtData + (size_t)numRows * 30;
+			MinorBaseIdx = MajorBaseIdx + numRows;
+			Ambiguous = MinorBaseIdx + numRows;
+			InsertionCount = Ambiguous + numRows;
+			DeletionCount = InsertionCount + numRows;
+		}
+		
+		double* Entropy;
+		int32_t* Position;
+		int32_t* NtData;
+		int32_t* MajorBaseIdx;
+		int32_t* MinorBaseIdx;
+		int32_t* Ambiguous;
+		int32_t* InsertionCount;
+		int32_t* DeletionCount;
+	};
+	
+	static const char Magic[8];
+	
+	static size_t GetFileSize(int numRows)
+	{
+		return sizeof(Header) + (size_t)numRows * (sizeof(double) + 36 * sizeof(int32_t));
+	}
+	
+	string GetFilename(uint64_t key, int refId, int tileIdx) const
+	{
+		char keyString[17];
+		sprintf(keyString, "%016llx", (unsigned long long)key);
+		return m_Directory + "/" + keyString + "." + lexical_cast<string>(refId) + "." + lexical_cast<string>(tileIdx) + ".pileup";
+	}
+	
+	string m_Directory;
+};
+
+const int PileupCache::TileShift;
+const char PileupCache::Magic[8] = {'P', 'Y', 'B', 'P', 'I', 'L', 'E', '2'};
+
+class PyPileup
+{
+public:
+	PyPileup() : m_Statistics(PileupTupleStatistics), m_Summarize(&CalculatePileupSummary), m_IsSparse(false), m_PileupEngine(0), m_PileupQueue(0), m_PrefetchSize(0), m_PrefetchBuffer(0)
+	{
+		pthread_mutex_init(&m_AccessMutex, 0);
+	}
+	
+	~PyPileup()
+	{
+		StopPrefetch(false);
+		
+		delete m_PileupEngine;
+		delete m_PileupQueue;
+		
+		pthread_mutex_destroy(&m_AccessMutex);
+	}
+	
+	void Open(const string& bamFilename)
+	{
+		OpenFiltered(bamFilename, PileupFilter());
+	}
+	
+	void OpenFiltered(const string& bamFilename, const PileupFilter& filter)
+	{
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			StopPrefetch(false);
+			
+			m_Filter = filter;
+			
+			if (!m_BamReader.Open(bamFilename))
+			{
+				throw runtime_error("unable to open bam file " + bamFilename);
+			}
+			
+			if (!m_BamReader.LocateIndex())
+			{
+				throw runtime_error("unable to open index for bam file " + bamFilename);
+			}
+			
+			// Cached pileups are identified by the bam size, modification time and header
+			struct stat bamStat;
+			if (stat(bamFilename.c_str(), &bamStat) != 0)
+			{
+				throw runtime_error("unable to stat bam file " + bamFilename);
+			}
+			m_BamFilename = bamFilename;
+			m_BamIdentity = lexical_cast<string>(bamStat.st_size) + ":" + lexical_cast<string>(bamStat.st_mtime) + ":" + lexical_cast<string>(HashString(m_BamReader.GetHeaderText()));
+			m_CacheReader.Close();
+			
+			RestartPileupEngine();
+			
+			// Index weights guide sites queries, they are not required otherwise
+			if (!ParallelPileupEngine::ReadLinearIndexWeights(bamFilename + ".bai", (int)m_BamReader.GetReferenceCount(), m_IndexWeights))
+			{
+				m_IndexWeights.clear();
+			}
+			
+			StartPrefetch();
+		}
+		
+		RefNames = python::list();
+		for (RefVector::const_iterator refDataIter = m_BamReader.GetReferenceData().begin(); refDataIter != m_BamReader.GetReferenceData().end(); refDataIter++)
+		{
+			RefNames.append(refDataIter->RefName);
+		}
+	}
+	
+	void Rewind()
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		Reposition(-1, -1, -1);
+	}
+	
+	void JumpRef(const string& refName)
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		Reposition(GetReferenceID(refName), -1, -1);
+	}
+	
+	void JumpRefPosition(const string& refName, int position)
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		// Interface is 1-based, bamtools is 0-based
+		Reposition(GetReferenceID(refName), position - 1, -1);
+	}
+	
+	void SetIterRegion(const string& refName, int start, int end)
+	{
+		if (start < 1 || end < start)
+		{
+			throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		// Interface is 1-based closed, bamtools regions are 0-based half open
+		Reposition(GetReferenceID(refName), start - 1, end);
+	}
+	
+	void Prefetch(int prefetchSize)
+	{
+		if (prefetchSize < 0)
+		{
+			throw runtime_error("invalid prefetch size " + lexical_cast<string>(prefetchSize));
+		}
+		
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		StopPrefetch(true);
+		
+		m_PrefetchSize = prefetchSize;
+		
+		StartPrefetch();
+	}
+	
+	// Cache fetched pileups in a directory, or stop caching if the directory is empty
+	void Cache(const string& directory)
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		m_Cache.SetDirectory(directory);
+	}
+	
+	// Select the statistics computed from now on, positions already prefetched are unaffected
+	void Statistics(int statistics)
+	{
+		PileupSummaryFunction summarize = GetPileupSummaryFunction(statistics);
+		
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		StopPrefetch(true);
+		
+		m_Statistics = statistics;
+		m_Summarize = summarize;
+		if (m_PileupQueue != 0)
+		{
+			m_PileupQueue->Summarize = summarize;
+		}
+		
+		StartPrefetch();
+	}
+	
+	// Skip positions without coverage from now on, positions already prefetched are unaffected
+	void Sparse(bool sparse)
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		StopPrefetch(true);
+		
+		m_IsSparse = sparse;
+		if (m_PileupEngine != 0)
+		{
+			m_PileupEngine->SetSkipGaps(sparse);
+		}
+		
+		StartPrefetch();
+	}
+	
+	python::object Next()
+	{
+		PileupSummary summary;
+		bool hasSummary;
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupEngine == 0)
+			{
+				throw runtime_error("next called before open");
+			}
+			
+			const PileupSummary* nextSummary = PeekSummary();
+			
+			if (nextSummary != 0)
+			{
+				summary = *nextSummary;
+				PopSummary();
+			}
+			
+			hasSummary = (nextSummary != 0);
+		}
+		
+		if (!hasSummary)
+		{
+			return python::object();
+		}
+		
+		return CreatePileupTuple(summary);
+	}
+	
+	PileupBatchPtr NextBatch(int maxPositions)
+	{
+		if (maxPositions <= 0)
+		{
+			throw runtime_error("invalid batch size " + lexical_cast<string>(maxPositions));
+		}
+		
+		PileupBatchPtr batch = AcquireBatch(maxPositions);
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupEngine == 0)
+			{
+				throw runtime_error("next_batch called before open");
+			}
+			
+			const PileupSummary* summary;
+			while (batch->Size() < maxPositions && (summary = PeekSummary()) != 0)
+			{
+				batch->Append(*summary);
+				PopSummary();
+			}
+		}
+		
+		ReleaseOversizedBatch();
+		
+		return batch;
+	}
+	
+	PileupBatchPtr Fetch(const string& refName, int start, int end)
+	{
+		if (start < 1 || end < start)
+		{
+			throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		PileupBatchPtr batch = AcquireBatch(end - start + 1);
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			// Interface is 1-based closed, bamtools regions are 0-based half open
+			// N.B. - downsampled pileups depend on where reading starts, so are never cached
+			if (m_Cache.IsEnabled() && m_Filter.MaxDepth <= 0)
+			{
+				FetchCached(GetReferenceID(refName), start - 1, end, *batch);
+			}
+			else
+			{
+				Reposition(GetReferenceID(refName), start - 1, end);
+				
+				const PileupSummary* summary;
+				while ((summary = PeekSummary()) != 0)
+				{
+					batch->Append(*summary);
+					PopSummary();
+				}
+			}
+		}
+		
+		ReleaseOversizedBatch();
+		
+		return batch;
+	}
+	
+	PileupBatchPtr AtSites(const string& refName, python::object positions)
+	{
+		// Interface is 1-based, bamtools is 0-based
+		vector<int> sites;
+		ExtractPositions(positions, sites);
+		for (int siteIdx = 0; siteIdx < (int)sites.size(); siteIdx++)
+		{
+			if (sites[siteIdx] < 1 || (siteIdx > 0 && sites[siteIdx] < sites[siteIdx - 1]))
+			{
+				throw runtime_error("sites must be sorted positive positions, invalid position " + lexical_cast<string>(sites[siteIdx]));
+			}
+			sites[siteIdx]--;
+		}
+		
+		PileupBatchPtr batch = AcquireBatch((int)sites.size());
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupEngine == 0)
+			{
+				throw runtime_error("at_sites called before open");
+			}
+			
+			int refId = GetReferenceID(refName);
+			
+			StopPrefetch(false);
+			
+			PileupSummary siteSummary;
+			
+			int clusterStart = 0;
+			while (clusterStart < (int)sites.size())
+			{
+				int clusterEnd = FindSiteClusterEnd(refId, sites, clusterStart);
+				
+				// Stream through the cluster, visiting only its sites
+				SeekRegion(refId, sites[clusterStart], sites[clusterEnd - 1] + 1);
+				m_PileupEngine->SetSites(vector<int>(sites.begin() + clusterStart, sites.begin() + clusterEnd));
+				
+				// Sites without any reads are not visited by the engine, repeated sites are visited once
+				for (int siteIdx = clusterStart; siteIdx < clusterEnd; siteIdx++)
+				{
+					if (siteIdx == clusterStart || sites[siteIdx] != sites[siteIdx - 1])
+					{
+						const PileupSummary* summary = PeekSummary();
+						
+						if (summary != 0 && summary->Position == sites[siteIdx])
+						{
+							siteSummary = *summary;
+							PopSummary();
+						}
+						else
+						{
+							ClearPileupSummary(siteSummary);
+							FinishPileupSummary(refId, sites[siteIdx], 0, siteSummary);
+						}
+					}
+					
+					batch->Append(siteSummary);
+				}
+				
+				clusterStart = clusterEnd;
+			}
+			
+			StartPrefetch();
+		}
+		
+		ReleaseOversizedBatch();
+		
+		return batch;
+	}
+	
+	PileupColumnPtr Depth(const string& refName, int start, int end)
+	{
+		return CalculateDepth(refName, start, end, 0);
+	}
+	
+	PileupColumnPtr DepthFiltered(const string& refName, int start, int end, const PileupFilter& filter)
+	{
+		return CalculateDepth(refName, start, end, &filter);
+	}
+	
+	// Distinct inserted sequences following each position of the 1-based closed interval, as a list of
+	// (position, [(sequence, count), ...]) for the positions followed by an insertion
+	python::list Insertions(const string& refName, int start, int end)
+	{
+		if (start < 1 || end < start)
+		{
+			throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		InsertionCollector collector;
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupEngine == 0)
+			{
+				throw runtime_error("insertions called before open");
+			}
+			
+			int refId = GetReferenceID(refName);
+			
+			// Inserted bases are read from the packed BAM data, the pileup engine is left at the end of the region
+			StopPrefetch(false);
+			SeekRegion(refId, start - 1, end);
+			
+			PileupEngine insertionEngine;
+			insertionEngine.AddVisitor(&collector);
+			insertionEngine.SetFilter(m_Filter);
+			insertionEngine.SetRegion(BamRegion(refId, start - 1, refId, end));
+			insertionEngine.SetSkipGaps(true);
+			insertionEngine.SetAggregateInsertions(true);
+			
+			BamAlignment al;
+			while (m_BamReader.GetNextAlignmentCore(al))
+			{
+				insertionEngine.AddAlignment(al);
+			}
+			insertionEngine.Flush();
+			
+			StartPrefetch();
+		}
+		
+		python::list insertions;
+		for (int posIdx = 0; posIdx < (int)collector.Insertions.size(); posIdx++)
+		{
+			python::list alleles;
+			const vector<pair<string, int> >& posAlleles = collector.Insertions[posIdx].second;
+			for (int alleleIdx = 0; alleleIdx < (int)posAlleles.size(); alleleIdx++)
+			{
+				alleles.append(python::make_tuple(posAlleles[alleleIdx].first, posAlleles[alleleIdx].second));
+			}
+			insertions.append(python::make_tuple(collector.Insertions[posIdx].first + 1, alleles));
+		}
+		
+		return insertions;
+	}
+	
+	// Runs of positions of the 1-based closed interval skipped by sparse pileups for having no reads,
+	// as a list of (position, length), between the first and last positions with reads
+	python::list Gaps(const string& refName, int start, int end)
+	{
+		if (start < 1 || end < start)
+		{
+			throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		GapCollector collector;
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupEngine == 0)
+			{
+				throw runtime_error("gaps called before open");
+			}
+			
+			int refId = GetReferenceID(refName);
+			
+			// Gaps are found without building pileup data, the pileup engine is left at the end of the region
+			StopPrefetch(false);
+			SeekRegion(refId, start - 1, end);
+			
+			PileupEngine gapEngine;
+			gapEngine.AddVisitor(&collector);
+			gapEngine.SetFilter(m_Filter);
+			gapEngine.SetRegion(BamRegion(refId, start - 1, refId, end));
+			gapEngine.SetSkipGaps(true);
+			
+			BamAlignment al;
+			while (m_BamReader.GetNextAlignmentCore(al))
+			{
+				gapEngine.AddAlignment(al);
+			}
+			gapEngine.Flush();
+			
+			StartPrefetch();
+		}
+		
+		python::list gaps;
+		for (int gapIdx = 0; gapIdx < (int)collector.Gaps.size(); gapIdx++)
+		{
+			gaps.append(python::make_tuple(collector.Gaps[gapIdx].first + 1, collector.Gaps[gapIdx].second));
+		}
+		
+		return gaps;
+	}
+	
+	python::list RefNames;
+	
+private:
+	// Read depth of the 1-based closed interval, with the filters given at open unless others are specified
+	PileupColumnPtr CalculateDepth(const string& refName, int start, int end, const PileupFilter* filter)
+	{
+		if (start < 1 || end < start)
+		{
+			throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		PileupColumnPtr column(new PileupColumn("i", sizeof(int), 1));
+		column->Reserve(end - start + 1);
+		
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		if (m_PileupEngine == 0)
+		{
+			throw runtime_error("depth called before open");
+		}
+		
+		int refId = GetReferenceID(refName);
+		const PileupFilter depthFilter = (filter != 0) ? *filter : m_Filter;
+		
+		// Reads are counted directly, the pileup engine is left at the end of the region
+		StopPrefetch(false);
+		SeekRegion(refId, start - 1, end);
+		
+		DepthEngine depthEngine(BamRegion(refId, start - 1, refId, end));
+		depthEngine.SetFilter(depthFilter);
+		
+		// Base qualities are read from the packed BAM data, string fields are never needed
+		BamAlignment al;
+		while (m_BamReader.GetNextAlignmentCore(al))
+		{
+			depthEngine.AddAlignment(al);
+		}
+		
+		vector<int> depths;
+		depthEngine.GetDepths(depths);
+		memcpy(column->Row<int>(0), &depths[0], depths.size() * sizeof(int));
+		column->SetSize((int)depths.size());
+		
+		StartPrefetch();
+		
+		return column;
+	}
+	
+	// Serve a fetch of the 0-based half open interval from cached tiles, computing missing tiles with
+	// a separate reader so iteration is not disturbed, only positions covered by an alignment are cached
+	void FetchCached(int refId, int start, int end, PileupBatch& batch)
+	{
+		if (m_PileupEngine == 0)
+		{
+			throw runtime_error("fetch called before open");
+		}
+		
+		const string cacheKey = m_BamIdentity + ":" +
+			lexical_cast<string>(m_Filter.MinMapQuality) + ":" + lexical_cast<string>(m_Filter.MinBaseQuality) + ":" +
+			lexical_cast<string>(m_Filter.RequiredFlags) + ":" + lexical_cast<string>(m_Filter.FilteredFlags) + ":" +
+			lexical_cast<string>(m_Filter.ClipOverlaps) + ":" + lexical_cast<string>(m_Filter.MergeOverlappingMates) + ":" +
+			lexical_cast<string>(m_Filter.MaxDepth) + ":" +
+			lexical_cast<string>(m_Filter.DownsamplingSeed) + ":" + lexical_cast<string>(m_Statistics);
+		const uint64_t key = HashString(cacheKey);
+		
+		vector<PileupSummary> summaries;
+		for (int tileIdx = start >> PileupCache::TileShift; tileIdx <= (end - 1) >> PileupCache::TileShift; tileIdx++)
+		{
+			if (m_Cache.Read(key, refId, tileIdx, start, end, summaries))
+			{
+				continue;
+			}
+			
+			if (!m_CacheReader.IsOpen() && (!m_CacheReader.Open(m_BamFilename) || !m_CacheReader.LocateIndex()))
+			{
+				throw runtime_error("unable to open bam file " + m_BamFilename + " and its index");
+			}
+			
+			BamRegion region(refId, tileIdx << PileupCache::TileShift, refId, (tileIdx + 1) << PileupCache::TileShift);
+			
+			PileupCacheCollector collector(m_Summarize);
+			PileupEngine pileupEngine;
+			pileupEngine.AddVisitor(&collector);
+			pileupEngine.SetFilter(m_Filter);
+			pileupEngine.SetRegion(region);
+			pileupEngine.SetSkipGaps(true);
+			
+			if (m_CacheReader.SetRegion(PileupEngine::GetReadRegion(region)))
+			{
+				BamAlignment al;
+				while (m_CacheReader.GetNextAlignmentCore(al))
+				{
+					pileupEngine.AddAlignment(al);
+				}
+			}
+			pileupEngine.Flush();
+			
+			// An unwritable cache still serves the computed tile
+			m_Cache.Write(key, refId, tileIdx, collector.Summaries);
+			
+			vector<PileupSummary>::const_iterator summaryIter = collector.Summaries.begin();
+			for (; summaryIter != collector.Summaries.end(); ++summaryIter)
+			{
+				if (summaryIter->Position >= start && summaryIter->Position < end)
+				{
+					summaries.push_back(*summaryIter);
+				}
+			}
+		}
+		
+		if (m_IsSparse)
+		{
+			for (vector<PileupSummary>::const_iterator summaryIter = summaries.begin(); summaryIter != summaries.end(); ++summaryIter)
+			{
+				batch.Append(*summaryIter);
+			}
+			return;
+		}
+		
+		if (summaries.empty())
+		{
+			return;
+		}
+		
+		// Dense pileups also visit the uncovered positions between the first and last covered one,
+		// and the position after the last, at which the engine finds its window empty
+		PileupPosition emptyPosition;
+		emptyPosition.RefId = refId;
+		PileupSummary emptySummary;
+		
+		const int lastPosition = std::min(summaries.back().Position + 1, end - 1);
+		vector<PileupSummary>::const_iterator summaryIter = summaries.begin();
+		for (int position = summaries.front().Position; position <= lastPosition; position++)
+		{
+			if (summaryIter != summaries.end() && summaryIter->Position == position)
+			{
+				batch.Append(*summaryIter);
+				++summaryIter;
+			}
+			else
+			{
+				emptyPosition.Position = position;
+				m_Summarize(emptyPosition, emptySummary);
+				batch.Append(emptySummary);
+			}
+		}
+	}
+	
+	// Sites are streamed through while the compressed bytes between neighbouring sites cost
+	// less than a jump, which reloads index bins, seeks and decompresses a fresh block
+	int FindSiteClusterEnd(int refId, const vector<int>& sites, int clusterStart) const
+	{
+		static const int WindowShift = 14;
+		static const double JumpCost = 1 << 16;
+		
+		// Without index weights, assume every window holds a quarter of a jump
+		static const double DefaultWindowWeight = JumpCost / 4;
+		
+		const vector<double>* refWeights = (refId < (int)m_IndexWeights.size()) ? &m_IndexWeights[refId] : 0;
+		
+		int siteIdx = clusterStart + 1;
+		for (; siteIdx < (int)sites.size(); siteIdx++)
+		{
+			double streamCost = 0.0;
+			for (int windowIdx = sites[siteIdx - 1] >> WindowShift; windowIdx < sites[siteIdx] >> WindowShift && streamCost <= JumpCost; windowIdx++)
+			{
+				if (refWeights == 0)
+				{
+					streamCost += DefaultWindowWeight;
+				}
+				else if (windowIdx < (int)refWeights->size())
+				{
+					streamCost += (*refWeights)[windowIdx];
+				}
+			}
+			
+			if (streamCost > JumpCost)
+			{
+				break;
+			}
+		}
+		
+		return siteIdx;
+	}
+	
+	int GetReferenceID(const string& refName)
+	{
+		int refId = m_BamReader.GetReferenceID(refName);
+		
+		if (refId < 0)
+		{
+			throw runtime_error("invalid ref name " + refName);
+		}
+		
+		return refId;
+	}
+	
+	// Jump to a reference or rewind if refId is negative, optionally restricting
+	// pileups to the 0-based half open interval [start, end) on that reference
+	void Reposition(int refId, int start, int end)
+	{
+		if (m_PileupEngine == 0)
+		{
+			throw runtime_error("jump called before open");
+		}
+		
+		StopPrefetch(false);
+		SeekRegion(refId, start, end);
+		StartPrefetch();
+	}
+	
+	void SeekRegion(int refId, int start, int end)
+	{
+		// Reads are looked up from a little before the start, the engine ignores those ending before it
+		BamRegion region;
+		if (refId >= 0 && end >= 0)
+		{
+			region = BamRegion(refId, std::max(start, 0), refId, end);
+			m_BamReader.SetRegion(PileupEngine::GetReadRegion(region));
+		}
+		else if (refId >= 0)
+		{
+			region = BamRegion(refId, std::max(start, 0));
+			m_BamReader.Jump(refId, PileupEngine::GetReadRegion(region).LeftPosition);
+		}
+		else
+		{
+			m_BamReader.Rewind();
+		}
+		
+		RestartPileupEngine();
+		
+		// Engine output begins at the first position with reads from the start, and ends with the region
+		if (refId >= 0 && (start >= 0 || end >= 0))
+		{
+			m_PileupEngine->SetRegion(region);
+		}
+	}
+	
+	void RestartPileupEngine()
+	{
+		delete m_PileupEngine;
+		m_PileupEngine = new PileupEngine();
+		m_PileupEngine->SetFilter(m_Filter);
+		m_PileupEngine->SetSkipGaps(m_IsSparse);
+		
+		delete m_PileupQueue;
+		m_PileupQueue = new PileupQueue(m_Summarize);
+		
+		m_PileupEngine->AddVisitor(m_PileupQueue);
+	}
+	
+	bool FillQueue()
+	{
+		if (!m_PileupQueue->Pileups.empty())
+		{
+			return true;
+		}
+		
+		BamAlignment al;
+		while (m_BamReader.GetNextAlignmentCore(al))
+		{
+			m_PileupEngine->AddAlignment(al);
+			
+			if (!m_PileupQueue->Pileups.empty())
+			{
+				return true;
+			}
+		}
+		m_PileupEngine->Flush();
+		
+		return !m_PileupQueue->Pileups.empty();
+	}
+	
+	const PileupSummary* PeekSummary()
+	{
+		if (m_PrefetchBuffer == 0)
+		{
+			return FillQueue() ? &m_PileupQueue->Pileups.front() : 0;
+		}
+		
+		const PileupSummary* summary = m_PrefetchBuffer->Peek();
+		
+		if (summary == 0 && !m_PrefetchBuffer->Error().empty())
+		{
+			throw runtime_error(m_PrefetchBuffer->Error());
+		}
+		
+		return summary;
+	}
+	
+	void PopSummary()
+	{
+		if (m_PrefetchBuffer == 0)
+		{
+			m_PileupQueue->Pileups.pop_front();
+		}
+		else
+		{
+			m_PrefetchBuffer->Pop();
+		}
+	}
+	
+	void StartPrefetch()
+	{
+		if (m_PrefetchSize == 0 || m_PileupEngine == 0)
+		{
+			return;
+		}
+		
+		m_PrefetchBuffer = new PileupRingBuffer(m_PrefetchSize);
+		
+		if (pthread_create(&m_PrefetchThread, 0, &PyPileup::PrefetchMain, this) != 0)
+		{
+			delete m_PrefetchBuffer;
+			m_PrefetchBuffer = 0;
+			
+			throw runtime_error("unable to start prefetch thread");
+		}
+	}
+	
+	// Stop the producer thread, optionally keeping prefetched summaries for the next consumer
+	void StopPrefetch(bool keepPending)
+	{
+		if (m_PrefetchBuffer == 0)
+		{
+			return;
+		}
+		
+		m_PrefetchBuffer->Stop();
+		pthread_join(m_PrefetchThread, 0);
+		
+		if (keepPending)
+		{
+			m_PrefetchBuffer->Drain(m_PileupQueue->Pileups);
+		}
+		
+		delete m_PrefetchBuffer;
+		m_PrefetchBuffer = 0;
+	}
+	
+	static void* PrefetchMain(void* pileup)
+	{
+		static_cast<PyPileup*>(pileup)->RunPrefetch();
+		return 0;
+	}
+	
+	void RunPrefetch()
+	{
+		try
+		{
+			while (FillQueue())
+			{
+				if (!m_PrefetchBuffer->Push(m_PileupQueue->Pileups))
+				{
+					return;
+				}
+			}
+			
+			m_PrefetchBuffer->Finish("");
+		}
+		catch (const std::exception& e)
+		{
+			m_PrefetchBuffer->Finish(e.what());
+		}
+	}
+	
+	// Batch for at most the given number of positions, only a bounded part of which is reserved
+	// up front as regions may be whole chromosomes of mostly empty positions
+	PileupBatchPtr AcquireBatch(int maxPositions)
+	{
+		const int capacity = std::min(maxPositions, BatchReserveSize);
+		
+		// Reuse the previous batch buffers unless python still holds a reference
+		if (!m_Batch || !m_Batch.unique() || m_Batch->Capacity() < capacity)
+		{
+			m_Batch = PileupBatchPtr(new PileupBatch());
+			m_Batch->Reserve(capacity);
+		}
+		
+		m_Batch->Clear();
+		
+		return m_Batch;
+	}
+	
+	// Buffers of a batch grown past the reserve are left to python, rather than kept for reuse
+	void ReleaseOversizedBatch()
+	{
+		if (m_Batch && m_Batch->Capacity() > BatchReserveSize)
+		{
+			m_Batch.reset();
+		}
+	}
+	
+	
+	// Positions reserved for a batch up front, and kept for reuse at most
+	static const int BatchReserveSize = 1 << 16;
+	
+	BamReader m_BamReader;
+	PileupFilter m_Filter;
+	int m_Statistics;
+	PileupSummaryFunction m_Summarize;
+	bool m_IsSparse;
+	
+	string m_BamFilename;
+	string m_BamIdentity;
+	PileupCache m_Cache;
+	BamReader m_CacheReader;
+	vector<vector<double> > m_IndexWeights;
+	
+	PileupEngine* m_PileupEngine;
+	PileupQueue* m_PileupQueue;
+	PileupBatchPtr m_Batch;
+	
+	pthread_mutex_t m_AccessMutex;
+	
+	int m_PrefetchSize;
+	PileupRingBuffer* m_PrefetchBuffer;
+	pthread_t m_PrefetchThread;
+};
+
+const int PyPileup::BatchReserveSize;
+
+// Summaries of the positions with reads of one sample
+struct SamplePileupQueue : PileupVisitor
+{
+	void Visit(const PileupPosition& pileupData)
+	{
+		if (pileupData.PileupReads.empty())
+		{
+			return;
+		}
+		
+		Pileups.push_back(PileupSummary());
+		CalculatePileupSummary(pileupData, Pileups.back());
+	}
+	
+	std::deque<PileupSummary> Pileups;
+};
+
+// Lines up the positions of each sample, storing one summary per sample for positions
+// with reads in any sample, samples without reads there get an empty summary
+struct MultiPileupQueue
+{
+	MultiPileupQueue(int numSamples) : SampleQueues(numSamples)
+	{
+	}
+	
+	// Line up the positions before the given one, which every sample must have visited
+	void Merge(int refId, int position)
+	{
+		while (true)
+		{
+			const PileupSummary* first = 0;
+			for (vector<SamplePileupQueue>::const_iterator queueIter = SampleQueues.begin(); queueIter != SampleQueues.end(); ++queueIter)
+			{
+				if (!queueIter->Pileups.empty() && (first == 0 || IsBefore(queueIter->Pileups.front(), first->RefId, first->Position)))
+				{
+					first = &queueIter->Pileups.front();
+				}
+			}
+			
+			if (first == 0 || !IsBefore(*first, refId, position))
+			{
+				return;
+			}
+			
+			const int firstRefId = first->RefId;
+			const int firstPosition = first->Position;
+			for (vector<SamplePileupQueue>::iterator queueIter = SampleQueues.begin(); queueIter != SampleQueues.end(); ++queueIter)
+			{
+				std::deque<PileupSummary>& samplePileups = queueIter->Pileups;
+				if (!samplePileups.empty() && samplePileups.front().RefId == firstRefId && samplePileups.front().Position == firstPosition)
+				{
+					Pileups.push_back(samplePileups.front());
+					samplePileups.pop_front();
+				}
+				else
+				{
+					Pileups.push_back(PileupSummary());
+					ClearPileupSummary(Pileups.back());
+					FinishPileupSummary(firstRefId, firstPosition, 0, Pileups.back());
+				}
+			}
+		}
+	}
+	
+	static bool IsBefore(const PileupSummary& summary, int refId, int position)
+	{
+		return summary.RefId < refId || (summary.RefId == refId && summary.Position < position);
+	}
+	
+	vector<SamplePileupQueue> SampleQueues;
+	
+	// Summaries of all samples for each position, consecutively
+	std::deque<PileupSummary> Pileups;
+};
+
+class PyMultiPileup
+{
+public:
+	PyMultiPileup() : m_PileupQueue(0)
+	{
+		pthread_mutex_init(&m_AccessMutex, 0);
+	}
+	
+	~PyMultiPileup()
+	{
+		DeletePileupEngines();
+		delete m_PileupQueue;
+		
+		pthread_mutex_destroy(&m_AccessMutex);
+	}
+	
+	void Open(python::object bamFilenames)
+	{
+		OpenFiltered(bamFilenames, PileupFilter());
+	}
+	
+	void OpenFiltered(python::object bamFilenames, const PileupFilter& filter)
+	{
+		vector<string> filenames;
+		for (python::stl_input_iterator<string> filenameIter(bamFilenames), filenameEnd; filenameIter != filenameEnd; ++filenameIter)
+		{
+			filenames.push_back(*filenameIter);
+		}
+		
+		if (filenames.empty())
+		{
+			throw runtime_error("no bam files specified");
+		}
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (!m_BamReader.Open(filenames))
+			{
+				throw runtime_error("unable to open bam files " + m_BamReader.GetErrorString());
+			}
+			
+			if (!m_BamReader.LocateIndexes())
+			{
+				throw runtime_error("unable to open indices for bam files " + m_BamReader.GetErrorString());
+			}
+			
+			m_BamReader.SetExplicitMergeOrder(BamMultiReader::MergeByCoordinate);
+			
+			m_Filter = filter;
+			
+			// Samples are identified by the filename of each alignment
+			m_SampleIds.clear();
+			for (int sampleIdx = 0; sampleIdx < (int)filenames.size(); sampleIdx++)
+			{
+				m_SampleIds[filenames[sampleIdx]] = sampleIdx;
+			}
+			
+			if (m_SampleIds.size() != filenames.size())
+			{
+				throw runtime_error("duplicate bam filename");
+			}
+			
+			RestartPileupEngine();
+		}
+		
+		// Reference data of the multi reader is returned by value
+		const RefVector referenceData = m_BamReader.GetReferenceData();
+		
+		RefNames = python::list();
+		for (RefVector::const_iterator refDataIter = referenceData.begin(); refDataIter != referenceData.end(); refDataIter++)
+		{
+			RefNames.append(refDataIter->RefName);
+		}
+	}
+	
+	void Rewind()
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		Reposition(-1, -1, -1);
+	}
+	
+	void JumpRef(const string& refName)
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		Reposition(GetReferenceID(refName), -1, -1);
+	}
+	
+	void JumpRefPosition(const string& refName, int position)
+	{
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		// Interface is 1-based, bamtools is 0-based
+		Reposition(GetReferenceID(refName), position - 1, -1);
+	}
+	
+	void SetIterRegion(const string& refName, int start, int end)
+	{
+		if (start < 1 || end < start)
+		{
+			throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		ScopedGILRelease release;
+		ScopedLock lock(m_AccessMutex);
+		
+		// Interface is 1-based closed, bamtools regions are 0-based half open
+		Reposition(GetReferenceID(refName), start - 1, end);
+	}
+	
+	// Tuple with one pileup tuple per sample
+	python::object Next()
+	{
+		vector<PileupSummary> summaries;
+		
+		{
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupQueue == 0)
+			{
+				throw runtime_error("next called before open");
+			}
+			
+			if (FillQueue())
+			{
+				std::deque<PileupSummary>& pileups = m_PileupQueue->Pileups;
+				summaries.assign(pileups.begin(), pileups.begin() + m_SampleIds.size());
+				pileups.erase(pileups.begin(), pileups.begin() + m_SampleIds.size());
+			}
+		}
+		
+		if (summaries.empty())
+		{
+			return python::object();
+		}
+		
+		python::list sampleTuples;
+		for (vector<PileupSummary>::const_iterator summaryIter = summaries.begin(); summaryIter != summaries.end(); summaryIter++)
+		{
+			sampleTuples.append(CreatePileupTuple(*summaryIter));
+		}
+		
+		return python::tuple(sampleTuples);
+	}
+	
+	// List with one batch per sample, rows of the batches refer to the same positions
+	python::list NextBatch(int maxPositions)
+	{
+		if (maxPositions <= 0)
+		{
+			throw runtime_error("invalid batch size " + lexical_cast<string>(maxPositions));
+		}
+		
+		vector<PileupBatchPtr> batches;
+		for (int sampleIdx = 0; sampleIdx < (int)m_SampleIds.size(); sampleIdx++)
+		{
+			batches.push_back(PileupBatchPtr(new PileupBatch()));
+			batches.back()->Reserve(std::min(maxPositions, BatchReserveSize));
+		}
 		
-		// adjacent insertions and deletions
-		for (std::vector<CigarOp>::const_iterator opIter = ba.CigarData.begin(); opIter != ba.CigarData.end(); opIter++)
 		{
-			if (opIter->Type == 'I')
+			ScopedGILRelease release;
+			ScopedLock lock(m_AccessMutex);
+			
+			if (m_PileupQueue == 0)
 			{
-				insertionCount++;
+				throw runtime_error("next_batch called before open");
 			}
-			else if (opIter->Type == 'D')
+			
+			for (int positionIdx = 0; positionIdx < maxPositions && FillQueue(); positionIdx++)
 			{
-				deletionCount++;
+				for (int sampleIdx = 0; sampleIdx < (int)batches.size(); sampleIdx++)
+				{
+					batches[sampleIdx]->Append(m_PileupQueue->Pileups.front());
+					m_PileupQueue->Pileups.pop_front();
+				}
 			}
 		}
 		
-		if (pa.IsCurrentDeletion)
+		python::list sampleBatches;
+		for (vector<PileupBatchPtr>::const_iterator batchIter = batches.begin(); batchIter != batches.end(); batchIter++)
 		{
-			continue;
+			sampleBatches.append(*batchIter);
 		}
 		
-		char base = toupper(ba.QueryBases.at(pa.PositionInAlignment));
+		return sampleBatches;
+	}
+	
+	python::list RefNames;
+	
+private:
+	int GetReferenceID(const string& refName)
+	{
+		int refId = m_BamReader.GetReferenceID(refName);
 		
-		if (base == 'N')
+		if (refId < 0)
 		{
-			ambiguous++;
-			continue;
+			throw runtime_error("invalid ref name " + refName);
 		}
 		
-		int baseIdx;
-		switch (base)
+		return refId;
+	}
+	
+	// Jump to a reference or rewind if refId is negative, optionally restricting
+	// pileups to the 0-based half open interval [start, end) on that reference
+	void Reposition(int refId, int start, int end)
+	{
+		if (m_PileupQueue == 0)
 		{
-			case 'A': baseIdx = 0; break;
-			case 'C': baseIdx = 1; break;
-			case 'G': baseIdx = 2; break;
-			case 'T': baseIdx = 3; break;
-			default: throw runtime_error("unrecognized base " + string(1, base));
+			throw runtime_error("jump called before open");
 		}
 		
-		// count
-		ntData[baseIdx][0]++;
-		ntData[4][0]++;
-		
-		// quality
-		ntData[baseIdx][1] += ba.Qualities.at(pa.PositionInAlignment);
-		ntData[4][1] += ba.Qualities.at(pa.PositionInAlignment);
-		
-		// mapping quality
-		ntData[baseIdx][2] += ba.MapQuality;
-		ntData[4][2] += ba.MapQuality;
+		// Reads are looked up from a little before the start, the engine ignores those ending before it
+		BamRegion region;
+		if (refId >= 0 && end >= 0)
+		{
+			region = BamRegion(refId, std::max(start, 0), refId, end);
+			m_BamReader.SetRegion(PileupEngine::GetReadRegion(region));
+		}
+		else if (refId >= 0)
+		{
+			region = BamRegion(refId, std::max(start, 0));
+			m_BamReader.Jump(refId, PileupEngine::GetReadRegion(region).LeftPosition);
+		}
+		else
+		{
+			m_BamReader.Rewind();
+		}
 		
-		// distance
-		ntData[baseIdx][3] += (ba.IsReverseStrand()) ? ba.Length - pa.PositionInAlignment - 1 : pa.PositionInAlignment;
-		ntData[4][3] += (ba.IsReverseStrand()) ? ba.Length - pa.PositionInAlignment - 1 : pa.PositionInAlignment;
+		RestartPileupEngine();
 		
-		// direction
-		ntData[baseIdx][3] += (ba.IsReverseStrand()) ? 1 : 0;
-		ntData[4][3] += (ba.IsReverseStrand()) ? 1 : 0;
+		if (refId >= 0 && (start >= 0 || end >= 0))
+		{
+			for (vector<PileupEngine*>::iterator engineIter = m_PileupEngines.begin(); engineIter != m_PileupEngines.end(); ++engineIter)
+			{
+				(*engineIter)->SetRegion(region);
+			}
+		}
 	}
 	
-	// Identify major base
-	int majorBaseIdx = 0;
-	for (int baseIdx = 0; baseIdx < 4; baseIdx++)
+	// One engine per sample, so depth caps and mate pairs never mix samples
+	void RestartPileupEngine()
 	{
-		if (ntData[baseIdx][0] > ntData[majorBaseIdx][0])
+		DeletePileupEngines();
+		
+		delete m_PileupQueue;
+		m_PileupQueue = new MultiPileupQueue((int)m_SampleIds.size());
+		
+		for (int sampleIdx = 0; sampleIdx < (int)m_SampleIds.size(); sampleIdx++)
 		{
-			majorBaseIdx = baseIdx;
+			m_PileupEngines.push_back(new PileupEngine());
+			m_PileupEngines.back()->SetFilter(m_Filter);
+			m_PileupEngines.back()->SetSkipGaps(true);
+			m_PileupEngines.back()->AddVisitor(&m_PileupQueue->SampleQueues[sampleIdx]);
 		}
 	}
 	
-	// Identify minor base, initialize to base that is not the major base
-	int minorBaseIdx = (majorBaseIdx + 1) % 4;
-	for (int baseIdx = 0; baseIdx < 4; baseIdx++)
+	void DeletePileupEngines()
 	{
-		if (ntData[baseIdx][0] > ntData[minorBaseIdx][0] && baseIdx != majorBaseIdx)
+		for (vector<PileupEngine*>::iterator engineIter = m_PileupEngines.begin(); engineIter != m_PileupEngines.end(); ++engineIter)
 		{
-			minorBaseIdx = baseIdx;
+			delete *engineIter;
 		}
+		m_PileupEngines.clear();
 	}
 	
-	// Calculate entropy
-	double depth = (double)pileupData.PileupAlignments.size(); // NOTE: COPIED FROM JEFF, THIS MAY BE A WRONG
-	double entropy = 0.0;
-	for (int baseIdx = 0; baseIdx < 4; baseIdx++)
+	bool FillQueue()
 	{
-		double probability = (double)ntData[baseIdx][0] / depth;
-		if (probability != 0)
+		if (!m_PileupQueue->Pileups.empty())
+		{
+			return true;
+		}
+		
+		// Core reads carry their filename, the engines need no char data
+		BamAlignment al;
+		while (m_BamReader.GetNextAlignmentCore(al))
+		{
+			unordered_map<string,int>::const_iterator sampleIter = m_SampleIds.find(al.Filename);
+			if (sampleIter == m_SampleIds.end())
+			{
+				throw runtime_error("alignment from unknown bam file " + al.Filename);
+			}
+			
+			m_PileupEngines[sampleIter->second]->AddAlignment(al);
+			
+			// Positions before the alignment are complete once every sample has caught up to it
+			for (vector<PileupEngine*>::iterator engineIter = m_PileupEngines.begin(); engineIter != m_PileupEngines.end(); ++engineIter)
+			{
+				(*engineIter)->AdvanceTo(al.RefID, al.Position);
+			}
+			m_PileupQueue->Merge(al.RefID, al.Position);
+			
+			if (!m_PileupQueue->Pileups.empty())
+			{
+				return true;
+			}
+		}
+		
+		for (vector<PileupEngine*>::iterator engineIter = m_PileupEngines.begin(); engineIter != m_PileupEngines.end(); ++engineIter)
 		{
-			entropy -= (log(probability) * probability);
+			(*engineIter)->Flush();
 		}
+		m_PileupQueue->Merge(numeric_limits<int>::max(), 0);
+		
+		return !m_PileupQueue->Pileups.empty();
 	}
 	
-	// Interface is 1-based, bamtools is 0-based
-	int position = pileupData.Position + 1;
+	// Positions reserved for each sample batch up front
+	static const int BatchReserveSize = 1 << 16;
 	
-	return python::make_tuple(position,
-							  python::make_tuple(ntData[0][0], ntData[0][1], ntData[0][2], ntData[0][3], ntData[0][4], ntData[0][5]),
-							  python::make_tuple(ntData[1][0], ntData[1][1], ntData[1][2], ntData[1][3], ntData[1][4], ntData[1][5]),
-							  python::make_tuple(ntData[2][0], ntData[2][1], ntData[2][2], ntData[2][3], ntData[2][4], ntData[2][5]),
-							  python::make_tuple(ntData[3][0], ntData[3][1], ntData[3][2], ntData[3][3], ntData[3][4], ntData[3][5]),
-							  python::make_tuple(ntData[4][0], ntData[4][1], ntData[4][2], ntData[4][3], ntData[4][4], ntData[4][5]),
-							  majorBaseIdx,
-							  minorBaseIdx,
-							  ambiguous,
-							  insertionCount,
-							  entropy,
-							  deletionCount,
-							  pileupData.RefId
-							  );
-}
+	BamMultiReader m_BamReader;
+	unordered_map<string,int> m_SampleIds;
+	PileupFilter m_Filter;
+	
+	// Merged reads are split by sample between the engines, in the order of m_SampleIds
+	vector<PileupEngine*> m_PileupEngines;
+	MultiPileupQueue* m_PileupQueue;
+	
+	pthread_mutex_t m_AccessMutex;
+};
 
+const int PyMultiPileup::BatchReserveSize;
 
-struct PileupQueue : PileupVisitor
+// Collects pileup summaries of one tile into batches of bounded size, positions without
+// any aligned reads are dropped as tiles cannot know about gaps extending past their edges
+struct PileupTileCollector : PileupVisitor
 {
-	PileupQueue() : StartRefId(-1), StartPosition(-1) {}
+	PileupTileCollector(int maxBatchSize) : MaxBatchSize(maxBatchSize) {}
 	
 	void Visit(const PileupPosition& pileupData)
 	{
-		// Reset if we ended up on the wrong chromosome
-		if (StartRefId >= 0 && pileupData.RefId != StartRefId)
+		if (pileupData.PileupReads.empty())
 		{
-			StartRefId = -1;
-			StartPosition = -1;
+			return;
 		}
 		
-		// Dont store tuples before the start position
-		if (pileupData.Position < StartPosition)
+		// Batch capacity doubles up to the maximum, as the size of the tile is unknown
+		if (Batches.empty() || Batches.back()->Size() == Batches.back()->Capacity())
 		{
-			return;
+			int batchSize = Batches.empty() ? MinBatchSize : std::min(2 * Batches.back()->Capacity(), MaxBatchSize);
+			Batches.push_back(PileupBatchPtr(new PileupBatch()));
+			Batches.back()->Reserve(batchSize);
 		}
 		
-		Pileups.push(CreatePileupTuple(pileupData));
-		
-		// Reset start refid/position to have no further effect
-		StartRefId = -1;
-		StartPosition = -1;
+		CalculatePileupSummary(pileupData, Summary);
+		Batches.back()->Append(Summary);
 	}
 	
-	void Clear()
-	{
-		std::queue<python::tuple> empty;
-		swap(Pileups, empty);
-	}
+	static const int MinBatchSize = 1 << 10;
 	
-	std::queue<python::tuple> Pileups;
-	int StartRefId;
-	int StartPosition;
+	int MaxBatchSize;
+	PileupSummary Summary;
+	vector<PileupBatchPtr> Batches;
 };
 
-class PyPileup
+const int PileupTileCollector::MinBatchSize;
+
+// Hands out a collector per tile and delivers the batches of finished tiles to a python sink
+class ParallelPileupSink : public ParallelPileupVisitor
 {
 public:
-	PyPileup() : m_PileupEngine(0), m_PileupQueue(0)
+	ParallelPileupSink(python::object sink) : m_Append(PyCallable_Check(sink.ptr()) ? sink : sink.attr("append"))
 	{
 	}
 	
-	~PyPileup()
+	PileupVisitor* CreateVisitor()
 	{
-		delete m_PileupEngine;
-		delete m_PileupQueue;
+		return new PileupTileCollector(MaxBatchSize);
 	}
 	
-	void Open(const string& bamFilename)
+	// Called without the GIL by the engine
+	void MergeVisitor(PileupVisitor* visitor)
 	{
-		if (!m_BamReader.Open(bamFilename))
-		{
-			throw runtime_error("unable to open bam file " + bamFilename);
-		}
+		const vector<PileupBatchPtr>& batches = static_cast<PileupTileCollector*>(visitor)->Batches;
 		
-		if (!m_BamReader.LocateIndex())
-		{
-			throw runtime_error("unable to open index for bam file " + bamFilename);
-		}
+		ScopedGILAcquire acquire;
 		
-		RefNames = python::list();
-		for (RefVector::const_iterator refDataIter = m_BamReader.GetReferenceData().begin(); refDataIter != m_BamReader.GetReferenceData().end(); refDataIter++)
+		for (vector<PileupBatchPtr>::const_iterator batchIter = batches.begin(); batchIter != batches.end(); batchIter++)
 		{
-			RefNames.append(refDataIter->RefName);
+			m_Append(*batchIter);
 		}
-		
-		RestartPileupEngine();
 	}
 	
-	void Rewind()
-	{
-		m_BamReader.Rewind();
-		
-		RestartPileupEngine();
-	}
+private:
+	static const int MaxBatchSize = 1 << 16;
 	
-	void JumpRef(const string& refName)
+	python::object m_Append;
+};
+
+const int ParallelPileupSink::MaxBatchSize;
+
+void RunParallelPileupFiltered(const string& bamFilename, python::object regions, int numThreads, python::object sink, const PileupFilter& filter)
+{
+	if (numThreads <= 0)
 	{
-		int refId = m_BamReader.GetReferenceID(refName);
-		
-		if (refId < 0)
-		{
-			throw runtime_error("invalid ref name " + refName);
-		}
-		
-		m_BamReader.Jump(refId);
-		
-		RestartPileupEngine();
+		throw runtime_error("invalid number of threads " + lexical_cast<string>(numThreads));
 	}
 	
-	void JumpRefPosition(const string& refName, int position)
+	BamReader bamReader;
+	if (!bamReader.Open(bamFilename))
 	{
-		// Interface is 1-based, bamtools is 0-based
-		position -= 1;
-		
-		int refId = m_BamReader.GetReferenceID(refName);
-		
-		if (refId < 0)
-		{
-			throw runtime_error("invalid ref name " + refName);
-		}
-		
-		m_BamReader.Jump(refId, position);
-		
-		RestartPileupEngine();
-		
-		m_PileupQueue->StartRefId = refId;
-		m_PileupQueue->StartPosition = position;
+		throw runtime_error("unable to open bam file " + bamFilename);
 	}
 	
-	python::object Next()
+	const RefVector& references = bamReader.GetReferenceData();
+	
+	ParallelPileupEngine parallelPileup(numThreads);
+	parallelPileup.SetFilter(filter);
+	parallelPileup.SetCoreAlignmentsOnly(true);
+	
+	// Regions are (ref, start, end) 1-based closed intervals, all references if none
+	if (regions.ptr() != Py_None)
 	{
-		if (m_PileupEngine == 0)
-		{
-			throw runtime_error("next called before open");
-		}
-		
-		if (!m_PileupQueue->Pileups.empty())
-		{
-			return PopPileup();
-		}
-		
-		BamAlignment al;
-		while (m_BamReader.GetNextAlignment(al))
+		vector<PileupTile> bamRegions;
+		for (python::stl_input_iterator<python::object> regionIter(regions), regionEnd; regionIter != regionEnd; ++regionIter)
 		{
-			m_PileupEngine->AddAlignment(al);
+			string refName = python::extract<string>((*regionIter)[0]);
+			int start = python::extract<int>((*regionIter)[1]);
+			int end = python::extract<int>((*regionIter)[2]);
 			
-			if (!m_PileupQueue->Pileups.empty())
+			int refId = bamReader.GetReferenceID(refName);
+			if (refId < 0)
 			{
-				return PopPileup();
+				throw runtime_error("invalid ref name " + refName);
 			}
-		}
-		m_PileupEngine->Flush();
-		
-		if (!m_PileupQueue->Pileups.empty())
-		{
-			return PopPileup();
+			
+			if (start < 1 || end < start)
+			{
+				throw runtime_error("invalid region " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+			}
+			
+			bamRegions.push_back(PileupTile(refId, start - 1, std::min(end, references[refId].RefLength)));
 		}
 		
-		return python::object();
+		parallelPileup.SetRegions(bamRegions);
 	}
 	
-	python::list RefNames;
+	ParallelPileupSink parallelPileupSink(sink);
 	
-private:
-	void RestartPileupEngine()
+	bool success;
 	{
-		delete m_PileupEngine;
-		m_PileupEngine = new PileupEngine();
-		
-		delete m_PileupQueue;
-		m_PileupQueue = new PileupQueue();
-		
-		m_PileupEngine->AddVisitor(m_PileupQueue);
+		ScopedGILRelease release;
+		success = parallelPileup.Run(bamFilename, &parallelPileupSink);
 	}
 	
-	python::object PopPileup()
+	if (!success)
 	{
-		python::tuple tpl;
-		swap(tpl, m_PileupQueue->Pileups.front());
-		m_PileupQueue->Pileups.pop();
-		
-		return tpl;
+		throw runtime_error(parallelPileup.GetErrorString());
 	}
-	
-	BamReader m_BamReader;
-	
-	PileupEngine* m_PileupEngine;
-	PileupQueue* m_PileupQueue;
-};
+}
+
+void RunParallelPileup(const string& bamFilename, python::object regions, int numThreads, python::object sink)
+{
+	RunParallelPileupFiltered(bamFilename, regions, numThreads, sink, PileupFilter());
+}
 
 class PyFasta
 {
 public:
-	PyFasta() : m_IsOpen(false)
+	PyFasta() : m_IsOpen(false), m_IsPacked(false)
 	{
 	}
 	
@@ -335,6 +2486,11 @@ public:
 		{
 			m_Fasta.Close();
 		}
+		
+		if (m_IsPacked)
+		{
+			m_Packed.Close();
+		}
 	}
 	
 	void Open(const string& fastaFilename)
@@ -351,7 +2507,8 @@ public:
 			throw runtime_error("index file " + indexFilename + " not found");
 		}
 		
-		if (!m_Fasta.Open(fastaFilename, indexFilename))
+		// Mapped pages serve lookups without any system calls, and are shared between processes
+		if (!m_Fasta.Open(fastaFilename, indexFilename, true))
 		{
 			throw runtime_error("unable to open fasta file " + fastaFilename);
 		}
@@ -364,9 +2521,27 @@ public:
 		
 		m_RefLengths = m_Fasta.GetReferenceLengths();
 		
+		m_FastaFilename = fastaFilename;
 		m_IsOpen = true;
 	}
 	
+	void Pack(size_t memoryBudget)
+	{
+		if (!m_IsOpen)
+		{
+			throw runtime_error("pack called before open");
+		}
+		
+		// Packed lookups return the same bases as the fasta file, case and IUPAC codes included
+		if (!m_IsPacked && !m_Packed.Open(m_FastaFilename, m_FastaFilename + ".fai"))
+		{
+			throw runtime_error("unable to pack fasta file " + m_FastaFilename + ": " + m_Packed.GetErrorString());
+		}
+		
+		m_Packed.SetMemoryBudget(memoryBudget);
+		m_IsPacked = true;
+	}
+	
 	python::object GetPosition(const string& refName, int position)
 	{
 		// Interface is 1-based, bamtools is 0-based
@@ -385,7 +2560,16 @@ public:
 		int refId = refNameIdIter->second;
 		
 		char referenceBase = 'N';
-		if (!m_Fasta.GetBase(refId, position, referenceBase))
+		if (m_IsPacked)
+		{
+			string bases;
+			if (position < 0 || position >= m_RefLengths[refId] || !m_Packed.GetWindow(refId, position, 1, bases))
+			{
+				throw runtime_error("unable to get base at " + refName + ":" + lexical_cast<string>(position));
+			}
+			referenceBase = bases[0];
+		}
+		else if (!m_Fasta.GetBase(refId, position, referenceBase))
 		{
 			throw runtime_error("unable to get base at " + refName + ":" + lexical_cast<string>(position));
 		}
@@ -393,29 +2577,229 @@ public:
 		return python::make_tuple(referenceBase, 0, 0, 0, 0);
 	}
 	
+	string GetSequence(const string& refName, int start, int end)
+	{
+		if (!m_IsOpen)
+		{
+			throw runtime_error("get_sequence called before open");
+		}
+		
+		unordered_map<string,int>::const_iterator refNameIdIter = m_RefNameId.find(refName);
+		if (refNameIdIter == m_RefNameId.end())
+		{
+			throw runtime_error("unknown ref name " + refName);
+		}
+		int refId = refNameIdIter->second;
+		
+		// Interface is 1-based closed, bamtools is 0-based closed
+		string sequence;
+		if (start < 1 || end < start || end > m_RefLengths[refId])
+		{
+			throw runtime_error("unable to get sequence " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		bool found = m_IsPacked ? m_Packed.GetWindow(refId, start - 1, end - start + 1, sequence) : m_Fasta.GetSequence(refId, start - 1, end - 1, sequence);
+		if (!found)
+		{
+			throw runtime_error("unable to get sequence " + refName + ":" + lexical_cast<string>(start) + "-" + lexical_cast<string>(end));
+		}
+		
+		return sequence;
+	}
+	
 private:
 	Fasta m_Fasta;
+	PackedReference m_Packed;
+	string m_FastaFilename;
 	bool m_IsOpen;
+	bool m_IsPacked;
 	unordered_map<string,int> m_RefNameId;
 	vector<int> m_RefLengths;
 };
 
+// Writes the .fai index of a fasta file next to it, scanning large files on up to numThreads threads
+void IndexFasta(const string& fastaFilename, int numThreads)
+{
+	if (!Utilities::FileExists(fastaFilename))
+	{
+		throw runtime_error("invalid fasta file " + fastaFilename);
+	}
+	
+	Fasta fasta;
+	if (!fasta.Open(fastaFilename))
+	{
+		throw runtime_error("unable to open fasta file " + fastaFilename);
+	}
+	
+	if (!fasta.CreateIndex(fastaFilename + ".fai", numThreads))
+	{
+		throw runtime_error("unable to index fasta file " + fastaFilename);
+	}
+}
+
+// Iterator over the remaining pileups for for loops, ending where next returns None, the
+// pileup itself keeps its position so that next may be called after a loop ends
+template <typename TPileup>
+class PileupIterator
+{
+public:
+	PileupIterator(python::object pileup) : m_Pileup(pileup)
+	{
+	}
+	
+	python::object Next()
+	{
+		python::object pileupTuple = python::extract<TPileup&>(m_Pileup)().Next();
+		
+		if (pileupTuple.ptr() == Py_None)
+		{
+			PyErr_SetNone(PyExc_StopIteration);
+			python::throw_error_already_set();
+		}
+		
+		return pileupTuple;
+	}
+	
+private:
+	python::object m_Pileup;
+};
+
+template <typename TPileup>
+PileupIterator<TPileup> IterPileup(python::object self)
+{
+	return PileupIterator<TPileup>(self);
+}
+
+template <typename TPileup>
+PileupIterator<TPileup> IterRegion(python::object self, const string& refName, int start, int end)
+{
+	python::extract<TPileup&> pileup(self);
+	pileup().SetIterRegion(refName, start, end);
+	return PileupIterator<TPileup>(self);
+}
+
+python::object IterSelf(python::object self)
+{
+	return self;
+}
+
 BOOST_PYTHON_MODULE(newpybam)
 {
 	using namespace python;
 	
+	// Worker threads take the GIL to call back into Python, which needs it to exist first
+	// N.B. - Python 3.7 onwards always creates the GIL, and deprecates this call
+#if PY_VERSION_HEX < 0x03070000
+	PyEval_InitThreads();
+#endif
+	
+	// Statistics selectable for pileup, combined as a bit mask
+	scope().attr("stat_counts") = (int)PileupCounts;
+	scope().attr("stat_qualities") = (int)PileupQualities;
+	scope().attr("stat_mapqualities") = (int)PileupMapQualities;
+	scope().attr("stat_distances") = (int)PileupDistances;
+	scope().attr("stat_entropy") = (int)PileupEntropy;
+	scope().attr("stat_indels") = (int)PileupIndels;
+	scope().attr("stat_all") = (int)PileupTupleStatistics;
+	
+	class_<PileupFilter>("pileup_filter", init<>())
+		.def_readwrite("min_mapq", &PileupFilter::MinMapQuality)
+		.def_readwrite("min_baseq", &PileupFilter::MinBaseQuality)
+		.def_readwrite("include_flags", &PileupFilter::RequiredFlags)
+		.def_readwrite("exclude_flags", &PileupFilter::FilteredFlags)
+		.def_readwrite("clip_overlaps", &PileupFilter::ClipOverlaps)
+		.def_readwrite("merge_mates", &PileupFilter::MergeOverlappingMates)
+		.def_readwrite("max_depth", &PileupFilter::MaxDepth)
+		.def_readwrite("seed", &PileupFilter::DownsamplingSeed)
+	;
+	
 	class_<PyPileup>("pileup", init<>())
 		.def_readonly("refnames", &PyPileup::RefNames)
 		.def("open", &PyPileup::Open)
+		.def("open", &PyPileup::OpenFiltered)
 		.def("rewind", &PyPileup::Rewind)
 		.def("jump", &PyPileup::JumpRef)
 		.def("jump", &PyPileup::JumpRefPosition)
 		.def("next", &PyPileup::Next)
+		.def("next_batch", &PyPileup::NextBatch)
+		.def("fetch", &PyPileup::Fetch)
+		.def("at_sites", &PyPileup::AtSites)
+		.def("depth", &PyPileup::Depth)
+		.def("depth", &PyPileup::DepthFiltered)
+		.def("insertions", &PyPileup::Insertions)
+		.def("gaps", &PyPileup::Gaps)
+		.def("prefetch", &PyPileup::Prefetch)
+		.def("statistics", &PyPileup::Statistics)
+		.def("sparse", &PyPileup::Sparse)
+		.def("cache", &PyPileup::Cache)
+		.def("iter_region", &IterRegion<PyPileup>)
+		.def("__iter__", &IterPileup<PyPileup>)
+	;
+	
+	// Python 2 iterators are advanced by next, python 3 iterators by __next__
+	class_<PileupIterator<PyPileup> >("pileup_iterator", no_init)
+		.def("__iter__", &IterSelf)
+		.def("next", &PileupIterator<PyPileup>::Next)
+		.def("__next__", &PileupIterator<PyPileup>::Next)
+	;
+	
+	class_<PileupColumn, PileupColumnPtr, boost::noncopyable> pileupColumnClass("pileup_column", no_init);
+	pileupColumnClass
+		.def("__len__", &PileupColumn::Size)
+	;
+	
+	// Expose column storage through the buffer protocol for zero copy numpy access
+	static PyBufferProcs pileupColumnBufferProcs;
+	pileupColumnBufferProcs.bf_getbuffer = &PileupColumn::GetBuffer;
+	pileupColumnBufferProcs.bf_releasebuffer = 0;
+	PyTypeObject* pileupColumnType = reinterpret_cast<PyTypeObject*>(pileupColumnClass.ptr());
+	pileupColumnType->tp_as_buffer = &pileupColumnBufferProcs;
+#if PY_MAJOR_VERSION < 3
+	pileupColumnType->tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+	
+	class_<PileupBatch, PileupBatchPtr, boost::noncopyable>("pileup_batch", no_init)
+		.def("__len__", &PileupBatch::Size)
+		.add_property("position", make_getter(&PileupBatch::Position, return_internal_reference<>()))
+		.add_property("refid", make_getter(&PileupBatch::RefId, return_internal_reference<>()))
+		.add_property("ntdata", make_getter(&PileupBatch::NtData, return_internal_reference<>()))
+		.add_property("major", make_getter(&PileupBatch::MajorBaseIdx, return_internal_reference<>()))
+		.add_property("minor", make_getter(&PileupBatch::MinorBaseIdx, return_internal_reference<>()))
+		.add_property("ambiguous", make_getter(&PileupBatch::Ambiguous, return_internal_reference<>()))
+		.add_property("insertions", make_getter(&PileupBatch::InsertionCount, return_internal_reference<>()))
+		.add_property("entropy", make_getter(&PileupBatch::Entropy, return_internal_reference<>()))
+		.add_property("deletions", make_getter(&PileupBatch::DeletionCount, return_internal_reference<>()))
+	;
+	
+	class_<PyMultiPileup, boost::noncopyable>("multi_pileup", init<>())
+		.def_readonly("refnames", &PyMultiPileup::RefNames)
+		.def("open", &PyMultiPileup::Open)
+		.def("open", &PyMultiPileup::OpenFiltered)
+		.def("rewind", &PyMultiPileup::Rewind)
+		.def("jump", &PyMultiPileup::JumpRef)
+		.def("jump", &PyMultiPileup::JumpRefPosition)
+		.def("next", &PyMultiPileup::Next)
+		.def("next_batch", &PyMultiPileup::NextBatch)
+		.def("iter_region", &IterRegion<PyMultiPileup>)
+		.def("__iter__", &IterPileup<PyMultiPileup>)
 	;
 	
+	class_<PileupIterator<PyMultiPileup> >("multi_pileup_iterator", no_init)
+		.def("__iter__", &IterSelf)
+		.def("next", &PileupIterator<PyMultiPileup>::Next)
+		.def("__next__", &PileupIterator<PyMultiPileup>::Next)
+	;
+	
+	def("parallel_pileup", &RunParallelPileup);
+	def("parallel_pileup", &RunParallelPileupFiltered);
+	
 	class_<PyFasta>("fasta", init<>())
 		.def("open", &PyFasta::Open)
 		.def("get", &PyFasta::GetPosition)
+		.def("get_sequence", &PyFasta::GetSequence)
+		.def("pack", &PyFasta::Pack)
 	;
+	
+	def("index_fasta", &IndexFasta);
 }
 
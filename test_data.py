@@ -0,0 +1,264 @@
+
+# Writers for the small BAM and FASTA files used by the regression tests,
+# so the tests need nothing but newpybam itself
+
+import random
+import struct
+import zlib
+
+
+# BGZF block holding up to 64KB of uncompressed data
+def bgzf_block(data):
+    compressor = zlib.compressobj(6, zlib.DEFLATED, -15)
+    compressed = compressor.compress(data) + compressor.flush()
+    header = struct.pack('<BBBBIBBHBBHH', 31, 139, 8, 4, 0, 0, 255, 6, 66, 67, 2, len(compressed) + 25)
+    return header + compressed + struct.pack('<II', zlib.crc32(data) & 0xffffffff, len(data))
+
+
+class BgzfWriter(object):
+
+    max_block_size = 0xff00
+
+    def __init__(self, filename):
+        self.out = open(filename, 'wb')
+        self.buffer = b''
+        self.offset = 0
+        self.blocks = []
+
+    # Virtual offset of the next byte written
+    def tell(self):
+        return (self.offset << 16) | len(self.buffer)
+
+    # Start a new block unless the data fits in the current one
+    def reserve(self, length):
+        if len(self.buffer) + length > self.max_block_size:
+            self.flush()
+
+    def write(self, data):
+        while data:
+            self.reserve(1)
+            length = self.max_block_size - len(self.buffer)
+            self.buffer += data[:length]
+            data = data[length:]
+
+    def flush(self):
+        if self.buffer:
+            self.blocks.append((self.offset, len(self.buffer)))
+            block = bgzf_block(self.buffer)
+            self.out.write(block)
+            self.offset += len(block)
+            self.buffer = b''
+
+    def close(self):
+        self.flush()
+        self.out.write(bgzf_block(b''))
+        self.out.close()
+
+
+cigar_codes = 'MIDNSHP=X'
+
+
+def reference_length(cigar):
+    return sum(length for op, length in cigar if op in 'MDN=X')
+
+
+def reg2bin(beg, end):
+    end -= 1
+    for shift, offset in ((14, 4681), (17, 585), (20, 73), (23, 9), (26, 1)):
+        if beg >> shift == end >> shift:
+            return offset + (beg >> shift)
+    return 0
+
+
+class Read(object):
+
+    def __init__(self, name, flag, ref_id, position, mapq, cigar, sequence, qualities,
+                 mate_ref_id=-1, mate_position=-1, template_length=0):
+        self.name = name
+        self.flag = flag
+        self.ref_id = ref_id
+        self.position = position
+        self.mapq = mapq
+        self.cigar = cigar
+        self.sequence = sequence
+        self.qualities = qualities
+        self.mate_ref_id = mate_ref_id
+        self.mate_position = mate_position
+        self.template_length = template_length
+
+    def end(self):
+        return self.position + max(reference_length(self.cigar), 1)
+
+    def encode(self):
+        name = self.name.encode('ascii') + b'\0'
+        seq_codes = ['=ACMGRSVTWYHKDBN'.index(base) for base in self.sequence] + [0]
+        packed_seq = bytearray((seq_codes[i] << 4) | seq_codes[i + 1] for i in range(0, len(self.sequence), 2))
+        packed_cigar = b''.join(struct.pack('<I', (length << 4) | cigar_codes.index(op)) for op, length in self.cigar)
+        core = struct.pack('<iiBBHHHiiii', self.ref_id, self.position, len(name), self.mapq,
+                           reg2bin(self.position, self.end()), len(self.cigar), self.flag, len(self.sequence),
+                           self.mate_ref_id, self.mate_position, self.template_length)
+        data = core + name + packed_cigar + bytes(packed_seq) + bytes(bytearray(self.qualities))
+        return struct.pack('<i', len(data)) + data
+
+
+# Write coordinate sorted reads to a BAM file, and its .bai index
+def write_bam(filename, references, reads):
+    reads = sorted(reads, key=lambda read: (read.ref_id, read.position))
+
+    writer = BgzfWriter(filename)
+    text = b'@HD\tVN:1.4\tSO:coordinate\n'
+    header = b'BAM\1' + struct.pack('<i', len(text)) + text + struct.pack('<i', len(references))
+    for name, length in references:
+        header += struct.pack('<i', len(name) + 1) + name.encode('ascii') + b'\0' + struct.pack('<i', length)
+    writer.write(header)
+    writer.flush()
+
+    bins = [dict() for ref in references]
+    linear = [dict() for ref in references]
+    for read in reads:
+        data = read.encode()
+        writer.reserve(len(data))
+        start = writer.tell()
+        writer.write(data)
+        end = writer.tell()
+
+        chunks = bins[read.ref_id].setdefault(reg2bin(read.position, read.end()), [])
+        if chunks and chunks[-1][1] == start:
+            chunks[-1][1] = end
+        else:
+            chunks.append([start, end])
+
+        for window in range(read.position >> 14, ((read.end() - 1) >> 14) + 1):
+            linear[read.ref_id].setdefault(window, start)
+    writer.close()
+
+    with open(filename + '.bai', 'wb') as index:
+        index.write(b'BAI\1' + struct.pack('<i', len(references)))
+        for ref_bins, ref_linear in zip(bins, linear):
+            index.write(struct.pack('<i', len(ref_bins)))
+            for bin_id in sorted(ref_bins):
+                index.write(struct.pack('<Ii', bin_id, len(ref_bins[bin_id])))
+                for start, end in ref_bins[bin_id]:
+                    index.write(struct.pack('<QQ', start, end))
+            num_windows = max(ref_linear) + 1 if ref_linear else 0
+            index.write(struct.pack('<i', num_windows))
+            offset = 0
+            for window in range(num_windows):
+                offset = ref_linear.get(window, offset)
+                index.write(struct.pack('<Q', offset))
+
+
+def random_cigar(rng, length):
+    cigar = []
+    if rng.random() < 0.2:
+        cigar.append(('S', rng.randint(1, 10)))
+    remaining = length - sum(op_length for op, op_length in cigar)
+    while remaining > 0:
+        match = min(remaining, rng.randint(10, 60))
+        cigar.append(('M', match))
+        remaining -= match
+        if remaining > 5 and rng.random() < 0.15:
+            op = rng.choice('IDN')
+            op_length = {'I': rng.randint(1, 4), 'D': rng.randint(1, 4), 'N': rng.randint(50, 3000)}[op]
+            cigar.append((op, op_length))
+            if op == 'I':
+                remaining -= op_length
+    if cigar[-1][0] != 'M':
+        cigar.append(('M', 5))
+    return cigar
+
+
+def query_length(cigar):
+    return sum(length for op, length in cigar if op in 'MIS=X')
+
+
+# Random pairs of reads, some pairs overlapping, a stack of reads deep enough to downsample,
+# and a stretch in the middle of each reference without any reads
+def random_reads(references, seed, num_pairs):
+    rng = random.Random(seed)
+    reads = []
+
+    def add_pair(name, ref_id, position, mate_position):
+        pair = []
+        for is_first, read_position, other_position in ((True, position, mate_position), (False, mate_position, position)):
+            cigar = random_cigar(rng, rng.randint(40, 120))
+            length = query_length(cigar)
+            flag = 0x1 | 0x2 | (0x40 if is_first else 0x80)
+            if not is_first:
+                flag |= 0x10
+            else:
+                flag |= 0x20
+            if rng.random() < 0.05:
+                flag |= 0x400
+            sequence = ''.join(rng.choice('ACGTACGTACGTN') for i in range(length))
+            qualities = [rng.randint(2, 40) for i in range(length)]
+            pair.append(Read(name, flag, ref_id, read_position, rng.choice((0, 10, 30, 60, 60)), cigar, sequence,
+                             qualities, ref_id, other_position))
+
+        # Template length spans both reads, positive for the leftmost
+        template_length = max(read.end() for read in pair) - position
+        pair[0].template_length = template_length
+        pair[1].template_length = -template_length
+        reads.extend(pair)
+
+    for pair_idx in range(num_pairs):
+        ref_id = rng.randrange(len(references))
+        length = references[ref_id][1]
+        position = rng.randrange(0, length - 4000)
+        mate_position = position + rng.randint(0, 300)
+        add_pair('read%d' % pair_idx, ref_id, position, mate_position)
+
+    for pair_idx in range(150):
+        add_pair('deep%d' % pair_idx, 0, 1000 + rng.randint(0, 20), 1050 + rng.randint(0, 20))
+
+    def is_kept(read):
+        length = references[read.ref_id][1]
+        return read.end() <= length and (read.end() <= length // 2 or read.position >= length // 2 + 2000)
+
+    return [read for read in reads if is_kept(read)]
+
+
+# Write sequences to a FASTA file with lines of 60 bases, and its .fai index,
+# optionally compressed with BGZF and indexed by a .gzi
+def write_fasta(filename, sequences, compress=False):
+    lines = []
+    offset = 0
+    index = []
+    for name, sequence in sequences:
+        lines.append('>%s\n' % name)
+        offset += len(lines[-1])
+        index.append('%s\t%d\t%d\t60\t61\n' % (name, len(sequence), offset))
+        lines.extend(sequence[start:start + 60] + '\n' for start in range(0, len(sequence), 60))
+        offset += len(sequence) + (len(sequence) + 59) // 60
+    text = ''.join(lines).encode('ascii')
+
+    if compress:
+        writer = BgzfWriter(filename)
+        writer.write(text)
+        writer.close()
+        with open(filename + '.gzi', 'wb') as gzi:
+            gzi.write(struct.pack('<Q', len(writer.blocks) - 1))
+            uncompressed_offset = 0
+            for block_idx, (offset, length) in enumerate(writer.blocks):
+                if block_idx > 0:
+                    gzi.write(struct.pack('<QQ', offset, uncompressed_offset))
+                uncompressed_offset += length
+    else:
+        with open(filename, 'wb') as fasta:
+            fasta.write(text)
+
+    with open(filename + '.fai', 'w') as fai:
+        fai.writelines(index)
+
+
+# Random sequence in runs of upper and lower case bases, N and IUPAC codes
+def random_sequence(seed, length):
+    rng = random.Random(seed)
+    sequence = []
+    while len(sequence) < length:
+        if rng.random() < 0.1:
+            sequence.extend(rng.choice('NnRYKMSWrykmsw') * rng.randint(1, 50))
+        else:
+            bases = rng.choice(('ACGT', 'acgt'))
+            sequence.extend(rng.choice(bases) for i in range(rng.randint(1, 300)))
+    return ''.join(sequence[:length])
@@ -0,0 +1,132 @@
+
+# Regression tests of fasta lookups, memory-mapped, BGZF-compressed and packed,
+# against the sequences written by test_data, run with: python test_fasta.py
+
+import os
+import random
+import shutil
+import tempfile
+import unittest
+
+import newpybam
+import test_data
+
+
+sequences = [('chr1', test_data.random_sequence(1, 150000)),
+             ('chr2', test_data.random_sequence(2, 777)),
+             ('chr3', test_data.random_sequence(3, 1)),
+             ('chr4', test_data.random_sequence(4, 70000))]
+
+data_dir = None
+fasta_filenames = {}
+
+
+def setUpModule():
+    global data_dir
+    data_dir = tempfile.mkdtemp()
+
+    for name, compress in (('plain', False), ('bgzf', True)):
+        fasta_filenames[name] = os.path.join(data_dir, 'reference.fa' + ('.gz' if compress else ''))
+        test_data.write_fasta(fasta_filenames[name], sequences, compress)
+
+
+def tearDownModule():
+    shutil.rmtree(data_dir)
+
+
+class FastaTest(unittest.TestCase):
+
+    def open_fastas(self):
+        fastas = {}
+        for name, filename in fasta_filenames.items():
+            fastas[name] = newpybam.fasta()
+            fastas[name].open(filename)
+
+            # A budget of less than the largest reference evicts references between lookups
+            fastas[name + ' packed'] = newpybam.fasta()
+            fastas[name + ' packed'].open(filename)
+            fastas[name + ' packed'].pack(30000)
+        return fastas
+
+    # Every way of reading the file returns its sequence unchanged, case and IUPAC codes included
+    def test_get_sequence(self):
+        rng = random.Random(1)
+        for fasta_name, fasta in self.open_fastas().items():
+            for ref_name, sequence in rng.sample(sequences * 20, len(sequences) * 20):
+                self.assertEqual(fasta.get_sequence(ref_name, 1, len(sequence)), sequence, fasta_name)
+                start = rng.randint(1, len(sequence))
+                end = rng.randint(start, min(start + rng.choice((0, 10, 100000)), len(sequence)))
+                self.assertEqual(fasta.get_sequence(ref_name, start, end), sequence[start - 1:end], (fasta_name, ref_name, start, end))
+
+    def test_get(self):
+        for fasta_name, fasta in self.open_fastas().items():
+            for ref_name, sequence in sequences:
+                for position in range(1, len(sequence) + 1, 13):
+                    self.assertEqual(fasta.get(ref_name, position)[0], sequence[position - 1], (fasta_name, ref_name, position))
+
+    def test_invalid(self):
+        for fasta_name, fasta in self.open_fastas().items():
+            self.assertRaises(RuntimeError, fasta.get_sequence, 'chr2', 0, 3)
+            self.assertRaises(RuntimeError, fasta.get_sequence, 'chr2', 1, 778)
+            self.assertRaises(RuntimeError, fasta.get_sequence, 'chr5', 1, 1)
+            self.assertRaises(RuntimeError, fasta.get, 'chr5', 1)
+
+
+class IndexTest(unittest.TestCase):
+
+    def read_index(self, filename):
+        with open(filename + '.fai') as fai:
+            return fai.read()
+
+    # Index written by index_fasta, the one written by test_data moved out of the way
+    def create_index(self, filename, num_threads):
+        expected = self.read_index(filename)
+        os.rename(filename + '.fai', filename + '.fai.expected')
+        try:
+            newpybam.index_fasta(filename, num_threads)
+            return self.read_index(filename), expected
+        finally:
+            os.rename(filename + '.fai.expected', filename + '.fai')
+
+    def test_create_index(self):
+        index, expected = self.create_index(fasta_filenames['plain'], 1)
+        self.assertEqual(index, expected)
+
+    # Files of 32 MB or more are split between threads at headers, into chunks
+    # ending anywhere in the sequences
+    def test_create_index_threaded(self):
+        rng = random.Random(5)
+        chunk = test_data.random_sequence(5, 100000)
+        large_sequences = []
+        for ref_idx in range(40):
+            length = rng.randint(1, 4000000) if ref_idx % 2 else rng.choice((0, 1, 59, 60, 61, 1000))
+            large_sequences.append(('ref%d' % ref_idx, (chunk * (length // len(chunk) + 1))[:length]))
+
+        filename = os.path.join(data_dir, 'large.fa')
+        test_data.write_fasta(filename, large_sequences)
+        self.assertTrue(os.path.getsize(filename) >= 32 << 20)
+
+        for num_threads in (1, 2, 3, 8):
+            index, expected = self.create_index(filename, num_threads)
+            self.assertEqual(index, expected, num_threads)
+
+    # Within a sequence, only the last line may be shorter
+    def test_malformed(self):
+        filename = os.path.join(data_dir, 'malformed.fa')
+        for text in ('>chr1\nACGT\nAC\nACGT\n', '>chr1\nACGT\nACGTA\n', 'ACGT\n'):
+            with open(filename, 'w') as fasta:
+                fasta.write(text)
+            self.assertRaises(RuntimeError, newpybam.index_fasta, filename, 1)
+
+        # in the last chunk of a file split between threads
+        test_data.write_fasta(filename, [('ref%d' % ref_idx, 'ACGT' * 2000000) for ref_idx in range(5)])
+        with open(filename, 'r+b') as fasta:
+            fasta.seek(-1000, os.SEEK_END)
+            fasta.write(b'\n')
+        for num_threads in (1, 4):
+            self.assertRaises(RuntimeError, newpybam.index_fasta, filename, num_threads)
+        self.assertRaises(RuntimeError, newpybam.index_fasta, os.path.join(data_dir, 'missing.fa'), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,446 @@
+
+# Regression tests of the pileup interfaces against each other, on small BAM
+# files written by test_data, run with: python test_pileup.py
+
+import math
+import os
+import random
+import shutil
+import tempfile
+import unittest
+
+import numpy
+
+import newpybam
+import test_data
+
+
+references = [('chr1', 60000), ('chr2', 30000), ('chr3', 20000)]
+
+data_dir = None
+bam_filenames = []
+sample_reads = []
+
+
+def setUpModule():
+    global data_dir
+    data_dir = tempfile.mkdtemp()
+
+    # The second sample shares some pairs of the first, read names included
+    reads1 = test_data.random_reads(references, 1, 1500)
+    reads2 = test_data.random_reads(references, 2, 1000) + reads1[:200]
+    for sample_idx, reads in enumerate((reads1, reads2)):
+        bam_filenames.append(os.path.join(data_dir, 'sample%d.bam' % sample_idx))
+        sample_reads.append(reads)
+        test_data.write_bam(bam_filenames[-1], references, reads)
+
+
+def tearDownModule():
+    shutil.rmtree(data_dir)
+
+
+def create_filter(**attributes):
+    pileup_filter = newpybam.pileup_filter()
+    for name, value in attributes.items():
+        setattr(pileup_filter, name, value)
+    return pileup_filter
+
+
+def open_pileup(bam_filename, pileup_filter=None, sparse=False):
+    pileup = newpybam.pileup()
+    if pileup_filter is None:
+        pileup.open(bam_filename)
+    else:
+        pileup.open(bam_filename, pileup_filter)
+    pileup.sparse(sparse)
+    return pileup
+
+
+# Pileup tuple with nan entropy replaced, so tuples compare equal
+def comparable(row):
+    return tuple(None if isinstance(value, float) and math.isnan(value) else value for value in row)
+
+
+# Pileup tuples of the rows of a batch
+def batch_rows(batch):
+    ntdata = numpy.asarray(batch.ntdata).reshape(-1, 5, 6).tolist()
+    columns = [numpy.asarray(getattr(batch, name)).tolist() for name in
+               ('position', 'major', 'minor', 'ambiguous', 'insertions', 'entropy', 'deletions', 'refid')]
+    rows = []
+    for row_idx in range(len(batch)):
+        position, major, minor, ambiguous, insertions, entropy, deletions, ref_id = [column[row_idx] for column in columns]
+        nt = tuple(tuple(counts) for counts in ntdata[row_idx])
+        rows.append(comparable((position,) + nt + (major, minor, ambiguous, insertions, entropy, deletions, ref_id)))
+    return rows
+
+
+# Raw contents of the columns of a batch
+def batch_columns(batch):
+    return [numpy.asarray(getattr(batch, name)).tobytes() for name in
+            ('position', 'refid', 'ntdata', 'major', 'minor', 'ambiguous', 'insertions', 'entropy', 'deletions')]
+
+
+def scan(pileup):
+    rows = []
+    while True:
+        row = pileup.next()
+        if row is None:
+            return rows
+        rows.append(comparable(row))
+
+
+def region_rows(rows, ref_id, start, end):
+    return [row for row in rows if row[12] == ref_id and start <= row[0] <= end]
+
+
+def random_regions(seed, count):
+    rng = random.Random(seed)
+    regions = [('chr1', 1, 60000), ('chr1', 29000, 33000), ('chr2', 1, 1), ('chr3', 19990, 20000)]
+    for region_idx in range(count):
+        ref_name, length = rng.choice(references)
+        start = rng.randint(1, length)
+        regions.append((ref_name, start, min(start + rng.choice((0, 1, 10, 500, 5000)), length)))
+    return regions
+
+
+class FullScanTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.rows = scan(open_pileup(bam_filenames[0]))
+        cls.sparse_rows = scan(open_pileup(bam_filenames[0], sparse=True))
+
+    def test_iteration(self):
+        self.assertTrue(len(self.rows) > 0)
+        self.assertEqual([comparable(row) for row in open_pileup(bam_filenames[0])], self.rows)
+
+    # Loops leave next returning the rows after them, and loops over repositioned pileups end
+    def test_loop_exits(self):
+        pileup = open_pileup(bam_filenames[0])
+        for row_idx, row in enumerate(pileup):
+            if row_idx == 100:
+                break
+        self.assertEqual(comparable(pileup.next()), self.rows[101])
+        self.assertEqual([comparable(row) for row in pileup], self.rows[102:])
+        self.assertEqual(pileup.next(), None)
+
+        rows = []
+        for row in pileup.iter_region('chr2', 1, references[1][1]):
+            if not rows:
+                pileup.jump('chr3')
+            rows.append(comparable(row))
+        self.assertEqual(rows[1:], region_rows(self.rows, 2, 1, references[2][1]))
+
+    # Sparse pileups skip positions without reads
+    def test_sparse(self):
+        sparse_rows = set(self.sparse_rows)
+        self.assertEqual([row for row in self.rows if row in sparse_rows], self.sparse_rows)
+        self.assertEqual([row for row in self.rows if row not in sparse_rows and row[5][0] > 0], [])
+
+    # Gaps and the positions visited by sparse pileups partition the positions of dense pileups,
+    # except for the last, one past the last position with reads
+    def test_gaps(self):
+        pileup = open_pileup(bam_filenames[0])
+        sparse_pileup = open_pileup(bam_filenames[0], sparse=True)
+        regions = [(ref_name, 1, length) for ref_name, length in references] + random_regions(7, 200)
+        for ref_name, start, end in regions:
+            visited = [row[0] for row in sparse_pileup.iter_region(ref_name, start, end)]
+            positions = list(visited)
+            for position, length in pileup.gaps(ref_name, start, end):
+                self.assertTrue(length > 0)
+                positions.extend(range(position, position + length))
+            dense_positions = [row[0] for row in pileup.iter_region(ref_name, start, end)]
+            if dense_positions and visited and dense_positions[-1] == visited[-1] + 1:
+                dense_positions.pop()
+            self.assertEqual(sorted(positions), dense_positions, (ref_name, start, end))
+
+    def test_next_batch(self):
+        for batch_size in (1, 7, 1000, 10 ** 9):
+            pileup = open_pileup(bam_filenames[0])
+            rows = []
+            while True:
+                batch = pileup.next_batch(batch_size)
+                self.assertTrue(len(batch) <= batch_size)
+                if len(batch) == 0:
+                    break
+                rows.extend(batch_rows(batch))
+            self.assertEqual(rows, self.rows)
+
+    def test_prefetch(self):
+        for prefetch_size in (1, 100, 100000):
+            pileup = open_pileup(bam_filenames[0])
+            pileup.prefetch(prefetch_size)
+            self.assertEqual(scan(pileup), self.rows)
+
+    def test_jump(self):
+        pileup = open_pileup(bam_filenames[0])
+        for ref_id, (ref_name, length) in reversed(list(enumerate(references))):
+            pileup.jump(ref_name)
+            row = comparable(pileup.next())
+            self.assertEqual(row, region_rows(self.rows, ref_id, 1, length)[0])
+        pileup.rewind()
+        self.assertEqual(scan(pileup), self.rows)
+
+
+# Dense region pileups run from the first to one past the last position with reads in the region
+def expected_region_rows(rows, sparse_rows, ref_id, start, end):
+    covered = region_rows(sparse_rows, ref_id, start, end)
+    if not covered:
+        return []
+    return region_rows(rows, ref_id, covered[0][0], min(covered[-1][0] + 1, end))
+
+
+class RegionTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.rows = scan(open_pileup(bam_filenames[0]))
+        cls.sparse_rows = scan(open_pileup(bam_filenames[0], sparse=True))
+        cls.regions = random_regions(3, 40)
+
+    def test_iter_region(self):
+        for sparse in (False, True):
+            pileup = open_pileup(bam_filenames[0], sparse=sparse)
+            for ref_name, start, end in self.regions:
+                ref_id = pileup.refnames.index(ref_name)
+                if sparse:
+                    expected = region_rows(self.sparse_rows, ref_id, start, end)
+                else:
+                    expected = expected_region_rows(self.rows, self.sparse_rows, ref_id, start, end)
+                rows = [comparable(row) for row in pileup.iter_region(ref_name, start, end)]
+                self.assertEqual(rows, expected, (ref_name, start, end, sparse))
+
+    # Regions are 1-based, starts before 1 are rejected rather than read as the start of the reference
+    def test_invalid_region(self):
+        pileup = open_pileup(bam_filenames[0])
+        multi_pileup = newpybam.multi_pileup()
+        multi_pileup.open(bam_filenames)
+        for start, end in ((-20, 0), (0, 10), (10, 9)):
+            self.assertRaises(RuntimeError, pileup.iter_region, 'chr1', start, end)
+            self.assertRaises(RuntimeError, multi_pileup.iter_region, 'chr1', start, end)
+            self.assertRaises(RuntimeError, pileup.fetch, 'chr1', start, end)
+
+    def test_fetch(self):
+        for sparse in (False, True):
+            pileup = open_pileup(bam_filenames[0], sparse=sparse)
+            for ref_name, start, end in self.regions:
+                expected = [comparable(row) for row in pileup.iter_region(ref_name, start, end)]
+                self.assertEqual(batch_rows(pileup.fetch(ref_name, start, end)), expected, (ref_name, start, end, sparse))
+
+    # Cached fetches return the rows of uncached ones, whether or not the region was cached before
+    def test_cache(self):
+        cache_dir = tempfile.mkdtemp()
+        try:
+            for pileup_filter in (None, create_filter(min_baseq=20, merge_mates=True)):
+                for statistics in (newpybam.stat_all, newpybam.stat_counts):
+                    for sparse in (False, True):
+                        uncached = open_pileup(bam_filenames[0], pileup_filter, sparse)
+                        uncached.statistics(statistics)
+                        cached = open_pileup(bam_filenames[0], pileup_filter, sparse)
+                        cached.statistics(statistics)
+                        cached.cache(cache_dir)
+                        for ref_name, start, end in self.regions + self.regions[:5]:
+                            self.assertEqual(batch_columns(cached.fetch(ref_name, start, end)),
+                                             batch_columns(uncached.fetch(ref_name, start, end)),
+                                             (ref_name, start, end, sparse, statistics))
+        finally:
+            shutil.rmtree(cache_dir)
+
+
+class SitesTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.rows = scan(open_pileup(bam_filenames[0]))
+        cls.sparse_rows = scan(open_pileup(bam_filenames[0], sparse=True))
+
+    # Sites without reads get an empty row
+    def test_at_sites(self):
+        rng = random.Random(4)
+        sparse_rows = dict(((row[12], row[0]), row) for row in self.sparse_rows)
+        pileup = open_pileup(bam_filenames[0])
+        for ref_id, (ref_name, length) in enumerate(references):
+            sites = sorted(rng.randint(1, length) for site_idx in range(300))
+            sites = sorted(sites + sites[:10] + [row[0] for row in self.sparse_rows if row[12] == ref_id][::97])
+            rows = batch_rows(pileup.at_sites(ref_name, sites))
+            self.assertEqual([row[0] for row in rows], sites)
+            for row in rows:
+                if (ref_id, row[0]) in sparse_rows:
+                    self.assertEqual(row, sparse_rows[(ref_id, row[0])])
+                else:
+                    self.assertEqual(row[5][0], 0)
+
+    # Depth counts each read with a base or an ambiguous base at the position
+    def test_depth(self):
+        for attributes in ({}, {'merge_mates': True}, {'merge_mates': True, 'min_baseq': 20},
+                           {'min_mapq': 30, 'exclude_flags': 1024}):
+            pileup_filter = create_filter(**attributes)
+            pileup = open_pileup(bam_filenames[0], pileup_filter, sparse=True)
+            unfiltered = open_pileup(bam_filenames[0], sparse=True)
+            for ref_name, start, end in random_regions(5, 20):
+                batch = pileup.fetch(ref_name, start, end)
+                expected = numpy.zeros(end - start + 1, dtype=int)
+                positions = numpy.asarray(batch.position)
+                expected[positions - start] = numpy.asarray(batch.ntdata)[:, 24] + numpy.asarray(batch.ambiguous)
+                self.assertEqual(numpy.asarray(pileup.depth(ref_name, start, end)).tolist(), expected.tolist())
+                self.assertEqual(numpy.asarray(unfiltered.depth(ref_name, start, end, pileup_filter)).tolist(), expected.tolist())
+
+    # Insertions follow the base of the match before them, in random_cigar insertions always follow a match
+    def test_insertions(self):
+        expected = {}
+        for read in sample_reads[0]:
+            position = read.position
+            query_position = 0
+            for op, length in read.cigar:
+                if op == 'I':
+                    alleles = expected.setdefault((read.ref_id, position), {})
+                    sequence = read.sequence[query_position:query_position + length]
+                    alleles[sequence] = alleles.get(sequence, 0) + 1
+                if op in 'MDN':
+                    position += length
+                if op in 'MIS':
+                    query_position += length
+        self.assertTrue(len(expected) > 100)
+
+        pileup = open_pileup(bam_filenames[0])
+        regions = [(ref_name, 1, length) for ref_name, length in references] + random_regions(6, 200)
+        for ref_name, start, end in regions:
+            ref_id = pileup.refnames.index(ref_name)
+            insertions = [(position, sorted(alleles)) for position, alleles in pileup.insertions(ref_name, start, end)]
+            expected_insertions = [(position, sorted(alleles.items())) for (insertion_ref_id, position), alleles in
+                                   sorted(expected.items()) if insertion_ref_id == ref_id and start <= position <= end]
+            self.assertEqual(insertions, expected_insertions, (ref_name, start, end))
+
+
+# Positions with at least one read aligned, rather than skipped over
+def has_reads(row):
+    return row[5][0] + row[8] + row[11] > 0
+
+
+class ParallelTest(unittest.TestCase):
+
+    def test_parallel_pileup(self):
+        sparse_rows = scan(open_pileup(bam_filenames[0], sparse=True))
+        for num_threads in (1, 4):
+            batches = []
+            newpybam.parallel_pileup(bam_filenames[0], None, num_threads, batches)
+            self.assertEqual([row for batch in batches for row in batch_rows(batch)],
+                             [row for row in sparse_rows if has_reads(row)])
+
+    def test_regions(self):
+        regions = random_regions(6, 10)
+        pileup = open_pileup(bam_filenames[0], sparse=True)
+        expected = []
+        for ref_name, start, end in regions:
+            expected.extend(row for row in batch_rows(pileup.fetch(ref_name, start, end)) if has_reads(row))
+        for num_threads in (1, 3):
+            rows = []
+            newpybam.parallel_pileup(bam_filenames[0], regions, num_threads, lambda batch: rows.extend(batch_rows(batch)))
+            self.assertEqual(sorted(rows), sorted(expected))
+
+    def test_filter(self):
+        pileup_filter = create_filter(min_mapq=30, merge_mates=True, max_depth=20, seed=2)
+        sparse_rows = scan(open_pileup(bam_filenames[0], pileup_filter, sparse=True))
+        batches = []
+        newpybam.parallel_pileup(bam_filenames[0], None, 2, batches, pileup_filter)
+        self.assertEqual([row for batch in batches for row in batch_rows(batch)],
+                         [row for row in sparse_rows if has_reads(row)])
+
+
+# Each sample of a multi pileup has the rows of a pileup of its own file, with an
+# empty row where other samples have reads
+class MultiPileupTest(unittest.TestCase):
+
+    def check_samples(self, sample_rows, multi_rows):
+        samples = [dict(((row[12], row[0]), row) for row in rows) for rows in sample_rows]
+        positions = []
+        for rows in multi_rows:
+            self.assertEqual(len(rows), len(samples))
+            positions.append((rows[0][12], rows[0][0]))
+            for sample, row in zip(samples, rows):
+                if positions[-1] in sample:
+                    self.assertEqual(row, sample[positions[-1]])
+                else:
+                    self.assertFalse(has_reads(row))
+        self.assertEqual(positions, sorted(set(positions)))
+
+        expected = set(position for sample in samples for position, row in sample.items() if has_reads(row))
+        self.assertTrue(expected <= set(positions))
+
+    def test_multi_pileup(self):
+        for attributes in ({}, {'max_depth': 10, 'seed': 3}, {'merge_mates': True},
+                           {'merge_mates': True, 'min_baseq': 20, 'max_depth': 15}):
+            pileup_filter = create_filter(**attributes)
+            sample_rows = [scan(open_pileup(bam_filename, pileup_filter, sparse=True)) for bam_filename in bam_filenames]
+            multi_pileup = newpybam.multi_pileup()
+            multi_pileup.open(bam_filenames, pileup_filter)
+            self.check_samples(sample_rows, [[comparable(row) for row in rows] for rows in multi_pileup])
+
+    def test_regions(self):
+        multi_pileup = newpybam.multi_pileup()
+        multi_pileup.open(bam_filenames)
+        pileups = [open_pileup(bam_filename, sparse=True) for bam_filename in bam_filenames]
+        for ref_name, start, end in random_regions(7, 20):
+            sample_rows = [[comparable(row) for row in pileup.iter_region(ref_name, start, end)] for pileup in pileups]
+            multi_rows = [[comparable(row) for row in rows] for rows in multi_pileup.iter_region(ref_name, start, end)]
+            self.check_samples(sample_rows, multi_rows)
+
+    def test_next_batch(self):
+        multi_pileup = newpybam.multi_pileup()
+        multi_pileup.open(bam_filenames)
+        multi_rows = [[comparable(row) for row in rows] for rows in multi_pileup]
+        multi_pileup.rewind()
+        batch_rows_ = []
+        while True:
+            batches = multi_pileup.next_batch(1000)
+            if len(batches[0]) == 0:
+                break
+            batch_rows_.extend(zip(*[batch_rows(batch) for batch in batches]))
+        self.assertEqual([list(rows) for rows in batch_rows_], multi_rows)
+
+
+# Filtering reads matches a pileup of a file without the filtered reads
+class FilterTest(unittest.TestCase):
+
+    def check_filtered(self, pileup_filter, keep_read):
+        filtered_filename = os.path.join(data_dir, 'filtered.bam')
+        test_data.write_bam(filtered_filename, references, [read for read in sample_reads[0] if keep_read(read)])
+        self.assertEqual(scan(open_pileup(bam_filenames[0], pileup_filter)), scan(open_pileup(filtered_filename)))
+
+    def test_min_mapq(self):
+        self.check_filtered(create_filter(min_mapq=30), lambda read: read.mapq >= 30)
+
+    def test_flags(self):
+        self.check_filtered(create_filter(exclude_flags=1024), lambda read: read.flag & 1024 == 0)
+        self.check_filtered(create_filter(include_flags=64 | 32), lambda read: read.flag & (64 | 32) == 64 | 32)
+
+    # Bases and reads left out only ever lower the counts
+    def test_fewer_reads(self):
+        rows = dict(((row[12], row[0]), row) for row in scan(open_pileup(bam_filenames[0], sparse=True)))
+        for attributes in ({'min_baseq': 25}, {'merge_mates': True}, {'clip_overlaps': True}):
+            filtered_rows = scan(open_pileup(bam_filenames[0], create_filter(**attributes), sparse=True))
+            self.assertTrue(filtered_rows)
+            for row in filtered_rows:
+                self.assertTrue(row[5][0] <= rows[(row[12], row[0])][5][0])
+            self.assertTrue(sum(row[5][0] for row in filtered_rows) < sum(row[5][0] for row in rows.values()))
+
+    def test_downsampling(self):
+        rows = scan(open_pileup(bam_filenames[0]))
+        self.assertTrue(max(row[5][0] for row in rows) > 100)
+        self.assertEqual(scan(open_pileup(bam_filenames[0], create_filter(max_depth=10 ** 6))), rows)
+
+        downsampled_rows = {}
+        for seed in (1, 1, 2):
+            pileup_filter = create_filter(max_depth=25, seed=seed)
+            seed_rows = scan(open_pileup(bam_filenames[0], pileup_filter))
+            self.assertTrue(max(row[5][0] for row in seed_rows) <= 25)
+            self.assertEqual(downsampled_rows.setdefault(seed, seed_rows), seed_rows)
+
+            # Fetched regions are downsampled the same way every time
+            pileup = open_pileup(bam_filenames[0], pileup_filter)
+            self.assertEqual(batch_columns(pileup.fetch('chr1', 900, 1300)), batch_columns(pileup.fetch('chr1', 900, 1300)))
+        self.assertNotEqual(downsampled_rows[1], downsampled_rows[2])
+
+
+if __name__ == '__main__':
+    unittest.main()